@@ -0,0 +1,29 @@
+# Generate one benchmark clip with testffmpeg_genmedia, run with cmake -P
+#
+#  GENMEDIA   - the testffmpeg_genmedia executable
+#  OUTPUT     - the clip to write
+#  STAMP      - touched once the clip is done, or known to be unsupported
+#  CODEC      - the video codec, e.g. h264
+#  PIX_FMT    - the video pixel format, e.g. yuv420p10le
+#  CHANNELS   - the number of audio channels, 0 for none
+#  FRAMES     - the number of video frames
+#  SIZE       - the video size, e.g. 1280x720
+#
+# An FFmpeg build without an encoder for the clip isn't an error, the clip is left out
+# and its benchmark is reported as skipped.
+
+set(_args "${OUTPUT}" "${CODEC}" "${PIX_FMT}" --frames "${FRAMES}" --size "${SIZE}")
+if(CHANNELS GREATER 0)
+  list(APPEND _args --audio "${CHANNELS}")
+endif()
+
+file(REMOVE "${OUTPUT}")
+execute_process(COMMAND "${GENMEDIA}" ${_args} RESULT_VARIABLE _result)
+
+if(_result EQUAL 77)
+  message(STATUS "Skipping ${OUTPUT}, this FFmpeg can't encode ${CODEC} ${PIX_FMT}")
+elseif(NOT _result EQUAL 0)
+  message(FATAL_ERROR "Couldn't generate ${OUTPUT}: ${_result}")
+endif()
+
+file(WRITE "${STAMP}" "${_result}\n")
@@ -0,0 +1,74 @@
+# Run testffmpeg in benchmark mode on one clip and compare it with the baseline, run with cmake -P
+#
+#  TESTFFMPEG      - the testffmpeg executable
+#  NAME            - the benchmark name, the key in the baseline
+#  MEDIA           - the clip to play
+#  RESULT          - where testffmpeg writes the JSON results
+#  BASELINE        - the JSON baseline, {"<name>": {"fps": <fps>}, ...}
+#  TOLERANCE       - how many percent below the baseline frame rate is still a pass
+#  UPDATE_BASELINE - record this result in the baseline instead of comparing with it
+
+if(NOT EXISTS "${MEDIA}")
+  # The test is marked as skipped when this is printed
+  message("SKIPPED: ${MEDIA} wasn't generated, this FFmpeg can't encode it")
+  return()
+endif()
+
+get_filename_component(_result_dir "${RESULT}" DIRECTORY)
+file(MAKE_DIRECTORY "${_result_dir}")
+file(REMOVE "${RESULT}")
+execute_process(COMMAND "${TESTFFMPEG}" --benchmark "${RESULT}" "${MEDIA}"
+                RESULT_VARIABLE _result)
+if(NOT _result EQUAL 0 OR NOT EXISTS "${RESULT}")
+  message(FATAL_ERROR "testffmpeg failed on ${MEDIA}: ${_result}")
+endif()
+
+if(CMAKE_VERSION VERSION_LESS 3.19)
+  message("Results are in ${RESULT}, comparing them with the baseline needs CMake 3.19")
+  return()
+endif()
+
+file(READ "${RESULT}" _json)
+string(JSON _fps GET "${_json}" fps)
+string(JSON _frames GET "${_json}" frames)
+if(_frames EQUAL 0)
+  message(FATAL_ERROR "No video frames were shown from ${MEDIA}")
+endif()
+
+# CMake only does integer math, so frame rates are compared in thousandths
+function(fps_to_milli _value _out)
+  if(NOT _value MATCHES "^([0-9]+)(\\.([0-9]*))?$")
+    message(FATAL_ERROR "Bad frame rate '${_value}'")
+  endif()
+  set(_whole "${CMAKE_MATCH_1}")
+  string(SUBSTRING "${CMAKE_MATCH_3}000" 0 3 _fraction)
+  math(EXPR _milli "${_whole} * 1000 + 1${_fraction} - 1000")
+  set(${_out} ${_milli} PARENT_SCOPE)
+endfunction()
+
+set(_baseline "{}")
+if(EXISTS "${BASELINE}")
+  file(READ "${BASELINE}" _baseline)
+endif()
+
+if(UPDATE_BASELINE)
+  string(JSON _baseline SET "${_baseline}" "${NAME}" "{\"fps\": ${_fps}}")
+  file(WRITE "${BASELINE}" "${_baseline}\n")
+  message("Recorded ${NAME} at ${_fps} FPS in ${BASELINE}")
+  return()
+endif()
+
+string(JSON _baseline_fps ERROR_VARIABLE _error GET "${_baseline}" "${NAME}" fps)
+if(_error)
+  message("${NAME}: ${_fps} FPS, no baseline to compare with")
+  return()
+endif()
+
+fps_to_milli("${_fps}" _fps_milli)
+fps_to_milli("${_baseline_fps}" _baseline_milli)
+math(EXPR _minimum_milli "${_baseline_milli} * (100 - ${TOLERANCE}) / 100")
+if(_fps_milli LESS _minimum_milli)
+  message(FATAL_ERROR "${NAME} regressed: ${_fps} FPS, the baseline is ${_baseline_fps} FPS "
+                      "with ${TOLERANCE}% tolerance")
+endif()
+message("${NAME}: ${_fps} FPS, the baseline is ${_baseline_fps} FPS")
@@ -78,6 +78,21 @@ extern "C" {
 }
 #endif /* SDL_PLATFORM_WIN32 */
 
+#include "testffmpeg_audio.h"
+#include "testffmpeg_capture.h"
+#include "testffmpeg_cpu.h"
+#include "testffmpeg_filter.h"
+#include "testffmpeg_framecache.h"
+#include "testffmpeg_hugepages.h"
+#include "testffmpeg_hwcache.h"
+#include "testffmpeg_log.h"
+#include "testffmpeg_memory.h"
+#include "testffmpeg_pool.h"
+#include "testffmpeg_record.h"
+#include "testffmpeg_sprites.h"
+#include "testffmpeg_tempo.h"
+#include "testffmpeg_timestamp.h"
+#include "testffmpeg_trace.h"
 #include "testffmpeg_vulkan.h"
 
 #include "icon.h"
@@ -94,17 +109,40 @@ std::string make_ffmpeg_error_string(int error)
 #define av_err2str(errnum) make_ffmpeg_error_string(errnum).c_str()
 
 static SDL_Texture* sprite;
-static SDL_FRect* positions;
-static SDL_FRect* velocities;
+static SpriteLayer* sprites;
 static int sprite_w, sprite_h;
 static int num_sprites = 0;
+static SDL_bool sprite_collisions;
 
 static SDL_Window* window;
 static SDL_Renderer* renderer;
 static SDL_AudioStream* audio;
+static AudioRing* audio_ring;
+static int audio_latency_ms = 20;
 static SDL_Texture* video_texture;
-static Uint64 video_start;
+/* Video is paced by a clock that runs at playback_speed, it reads clock_pts at clock_ticks */
+static double playback_speed = 1.0;
+static double clock_pts;
+static Uint64 clock_ticks;
+static int video_frames_skipped;
+static AudioTempo* audio_tempo;
+static const char* video_filter_description;
+static VideoFilter* video_filter;
+/* Space pauses, and the arrow keys step a frame at a time through the frame cache */
+static SDL_bool paused;
+static SDL_bool stepped;
+static FrameCache* frame_cache;
+static int frame_cache_mb = DEFAULT_FRAME_CACHE_MB;
+/* Frames are only cached while playing when --frame-cache asks for it */
+static SDL_bool frame_cache_playback;
+static Sint64 shown_pts = AV_NOPTS_VALUE;
+static Sint64 decoded_pts = AV_NOPTS_VALUE;
+/* Playing again after stepping restarts from a keyframe, nothing before these is played */
+static AVRational resume_time_base;
+static Sint64 video_resume_pts = AV_NOPTS_VALUE;
+static Sint64 audio_resume_pts = AV_NOPTS_VALUE;
 static SDL_bool software_only;
+static SDL_bool use_hugepages;
 static SDL_bool has_eglCreateImage;
 #ifdef HAVE_EGL
 static SDL_bool has_EGL_EXT_image_dma_buf_import;
@@ -121,15 +159,277 @@ static const GUID SDL_IID_ID3D11Resource = {0xdc8e63f3,
                                             {0xb4, 0x7b, 0x5e, 0x45, 0x02, 0x6a, 0x86, 0x2d}};
 #endif
 static VulkanVideoContext* vulkan_context;
+/* Whether Vulkan video may be used, CreateWindowAndRenderer() checks the decoder can use it */
+static SDL_bool use_vulkan_video;
+static HWConfigCache* hw_config_cache;
 struct SwsContextContainer
 {
     struct SwsContext* context;
 };
 static const char* SWS_CONTEXT_CONTAINER_PROPERTY = "SWS_CONTEXT_CONTAINER";
+static WorkerPool* worker_pool;
+static SDL_bool memory_report;
+/* --benchmark plays headless as fast as possible and writes the results to this file */
+static const char* benchmark_file;
+static int audio_frames_decoded;
+static SDL_bool low_latency;
+static FrameCapture* frame_capture;
+static FrameCaptureFormat capture_format = FRAME_CAPTURE_PNG;
+static int capture_every;
+static SDL_bool capture_requested;
+static int frames_presented;
+static VideoRecorder* video_recorder;
 static int done;
 static SDL_bool verbose;
 
-static SDL_bool CreateWindowAndRenderer(SDL_WindowFlags window_flags, const char* driver)
+/* Input is read wherever the main thread waits, and acted on by the main loop */
+typedef struct PendingInput
+{
+    SDL_bool toggle_pause;
+    int frame_steps;
+    int speed_steps;
+    SDL_bool reset_speed;
+    SDL_bool capture;
+} PendingInput;
+
+static PendingInput pending_input;
+
+/* Pushed by other threads when they have something for the main loop */
+static Uint32 wake_event_type;
+static SDL_AtomicInt wake_pending;
+
+/* Each input of the video wall is decoded by tasks on the shared worker pool */
+#define VIDEO_TILE_QUEUE_SIZE 4
+
+typedef struct VideoTile
+{
+    const char* file;
+    AVFormatContext* ic;
+    int video_stream;
+    AVCodecContext* video_context;
+    AVPacket* pkt;
+    AVFrame* decoded;
+    AVFrame* scaled;
+    struct SwsContext* sws_context;
+
+    /* Protected by lock, shared between the render thread and the decode task */
+    SDL_Mutex* lock;
+    AVFrame* queue[VIDEO_TILE_QUEUE_SIZE];
+    int queue_head;
+    int queue_count;
+    int max_width; /* frames larger than twice this are downscaled before upload */
+    int max_height;
+    SDL_bool decoding; /* a decode task is queued or running */
+    SDL_bool finished;
+
+    /* Only used by the decode task */
+    SDL_bool flushing;
+
+    /* Only used by the render thread */
+    AVFrame* current;
+    SDL_Texture* texture;
+    double first_pts;
+    Uint64 start;
+} VideoTile;
+
+static VideoTile* video_tiles;
+static int num_video_tiles;
+
+/* Where the time goes for each video frame, the filter stage runs on its own thread */
+typedef enum VideoStage
+{
+    VIDEO_STAGE_DECODE,
+    VIDEO_STAGE_FILTER,
+    VIDEO_STAGE_RENDER,
+    VIDEO_STAGE_COUNT
+} VideoStage;
+
+static const char* video_stage_names[VIDEO_STAGE_COUNT] = {"decode", "filter", "render"};
+static Uint64 video_stage_ticks[VIDEO_STAGE_COUNT];
+static int video_stage_frames[VIDEO_STAGE_COUNT];
+
+/* The playback speeds stepped through with the '[' and ']' keys */
+static const double playback_speeds[] = {0.25, 0.5, 0.75, 1.0, 1.25, 1.5, 2.0, 3.0, 4.0};
+
+/* How long the decoder waits for the video filter thread before checking again */
+#define VIDEO_FILTER_WAIT_MS 10
+
+/* Above normal speed, frames this late are dropped instead of rendered */
+#define VIDEO_LATE_FRAME_S 0.05
+
+/* Above normal speed, only keyframes are decoded while video is this far behind */
+#define VIDEO_SKIP_TO_KEYFRAME_S 1.0
+
+/* With --low-latency, decoded audio is dropped while this much is already waiting to play */
+#define LOW_LATENCY_AUDIO_MS 60
+
+/* How often --low-latency logs the glass-to-glass latency */
+#define LATENCY_REPORT_INTERVAL_MS 1000
+
+/* Snapshots are written to the current directory, as capture-<frame>.png */
+#define CAPTURE_PREFIX "capture"
+
+/* The latency of frames that carry a timestamp pattern, from the source drawing the frame to
+ * it being presented
+ */
+typedef struct LatencyStats
+{
+    int frames;
+    Sint64 min_ms;
+    Sint64 max_ms;
+    Sint64 total_ms;
+} LatencyStats;
+
+static LatencyStats latency_interval;
+static LatencyStats latency_total;
+static Uint64 next_latency_report;
+static int audio_frames_dropped;
+
+/* Startup is timed from the start of main() until the first video frame is presented */
+typedef enum StartupStep
+{
+    STARTUP_SDL_INIT,
+    STARTUP_WINDOW,
+    STARTUP_VULKAN,
+    STARTUP_PROBE,
+    STARTUP_VIDEO_DECODER,
+    STARTUP_AUDIO,
+    STARTUP_FIRST_FRAME,
+    STARTUP_STEP_COUNT
+} StartupStep;
+
+static const char* startup_step_names[STARTUP_STEP_COUNT] = {
+    "SDL_Init", "window and renderer", "Vulkan context", "probe",
+    "video decoder", "audio", "first frame",
+};
+static Uint64 startup_time;
+static Uint64 startup_step_start[STARTUP_STEP_COUNT];
+static Uint64 startup_step_end[STARTUP_STEP_COUNT];
+static SDL_bool startup_finished;
+
+/* The file is opened and probed on its own thread while the window comes up */
+typedef struct ProbeData
+{
+    const char* file;
+    Sint64 probesize;       /* bytes, 0 for the FFmpeg default */
+    Sint64 analyzeduration; /* microseconds, 0 for the FFmpeg default */
+    SDL_bool fast_start;
+    SDL_bool low_latency;
+    AVFormatContext* ic;
+    int result;
+} ProbeData;
+
+/* The fast start preset, used unless the limits are given explicitly */
+#define FAST_START_PROBESIZE (128 * 1024)
+#define FAST_START_ANALYZEDURATION 500000
+
+/* The --low-latency preset, live sources have to start from whatever arrives first */
+#define LOW_LATENCY_PROBESIZE (32 * 1024)
+#define LOW_LATENCY_ANALYZEDURATION 100000
+
+static ProbeData probe;
+static SDL_Thread* probe_thread;
+
+/* The audio decoder and device are opened on their own thread while the video decoder opens */
+typedef struct AudioOpenData
+{
+    AVFormatContext* ic;
+    int stream;
+    const AVCodec* codec;
+    AVCodecContext* context;
+} AudioOpenData;
+
+static AudioOpenData audio_open;
+static SDL_Thread* audio_open_thread;
+
+static double GetStartupMS(Uint64 counter)
+{
+    return (double)(counter - startup_time) * 1000.0 / SDL_GetPerformanceFrequency();
+}
+
+static void BeginStartupStep(StartupStep step)
+{
+    startup_step_start[step] = SDL_GetPerformanceCounter();
+}
+
+static void EndStartupStep(StartupStep step)
+{
+    startup_step_end[step] = SDL_GetPerformanceCounter();
+}
+
+static void FinishStartup(void)
+{
+    if (startup_finished) {
+        return;
+    }
+    startup_finished = SDL_TRUE;
+
+    EndStartupStep(STARTUP_FIRST_FRAME);
+
+    /* Steps are listed as start and end times, overlapping steps ran concurrently */
+    SDL_Log("Startup timing:\n");
+    for (int i = 0; i < STARTUP_STEP_COUNT; ++i) {
+        if (!startup_step_end[i]) {
+            continue;
+        }
+        SDL_Log("    %-20s %8.2f - %8.2f ms (%.2f ms)\n", startup_step_names[i],
+                GetStartupMS(startup_step_start[i]), GetStartupMS(startup_step_end[i]),
+                GetStartupMS(startup_step_end[i]) - GetStartupMS(startup_step_start[i]));
+    }
+    SDL_Log("Time to first frame: %.2f ms\n", GetStartupMS(startup_step_end[STARTUP_FIRST_FRAME]));
+}
+
+static void JoinProbeThread(void)
+{
+    if (probe_thread) {
+        SDL_WaitThread(probe_thread, NULL);
+        probe_thread = NULL;
+    }
+}
+
+/* Whether the probed video stream could be decoded with Vulkan, which is the only case where the
+ * Vulkan renderer needs our own video context instead of creating its own device.
+ */
+static SDL_bool VideoStreamSupportsVulkan(const char* video_codec_name)
+{
+    const AVCodec* codec = NULL;
+    const AVCodecHWConfig* config;
+    int stream;
+
+    if (software_only) {
+        return SDL_FALSE;
+    }
+
+    JoinProbeThread();
+    if (!probe.ic) {
+        return SDL_FALSE;
+    }
+    stream = av_find_best_stream(probe.ic, AVMEDIA_TYPE_VIDEO, -1, -1, &codec, 0);
+    if (stream < 0) {
+        return SDL_FALSE;
+    }
+    if (video_codec_name) {
+        codec = avcodec_find_decoder_by_name(video_codec_name);
+        if (!codec) {
+            return SDL_FALSE;
+        }
+    }
+    if (IsHWConfigCacheFailure(hw_config_cache, codec->name, "vulkan", AV_HWDEVICE_TYPE_VULKAN)) {
+        return SDL_FALSE;
+    }
+
+    for (int i = 0; (config = avcodec_get_hw_config(codec, i)) != NULL; ++i) {
+        if (config->device_type == AV_HWDEVICE_TYPE_VULKAN &&
+            (config->methods & AV_CODEC_HW_CONFIG_METHOD_HW_DEVICE_CTX)) {
+            return SDL_TRUE;
+        }
+    }
+    return SDL_FALSE;
+}
+
+static SDL_bool CreateWindowAndRenderer(SDL_WindowFlags window_flags,
+                                        const char* driver,
+                                        const char* video_codec_name)
 {
     SDL_PropertiesID props;
     SDL_bool useOpenGL =
@@ -166,8 +466,15 @@ static SDL_bool CreateWindowAndRenderer(SDL_WindowFlags window_flags, const char
         return SDL_FALSE;
     }
 
-    if (useVulkan) {
+    if (useVulkan && use_vulkan_video) {
+        /* This waits for the probe, which kept running while the window was created */
+        use_vulkan_video = VideoStreamSupportsVulkan(video_codec_name);
+    }
+    if (useVulkan && use_vulkan_video) {
+        /* The renderer has to share the decoder's device, so this can't wait for the decoder */
+        BeginStartupStep(STARTUP_VULKAN);
         vulkan_context = CreateVulkanVideoContext(window);
+        EndStartupStep(STARTUP_VULKAN);
         if (!vulkan_context) {
             SDL_DestroyWindow(window);
             window = NULL;
@@ -178,7 +485,7 @@ static SDL_bool CreateWindowAndRenderer(SDL_WindowFlags window_flags, const char
     props = SDL_CreateProperties();
     SDL_SetStringProperty(props, SDL_PROP_RENDERER_CREATE_NAME_STRING, driver);
     SDL_SetProperty(props, SDL_PROP_RENDERER_CREATE_WINDOW_POINTER, window);
-    if (useVulkan) {
+    if (vulkan_context) {
         SetupVulkanRenderProperties(vulkan_context, props);
     }
     if (SDL_GetBooleanProperty(SDL_GetDisplayProperties(SDL_GetDisplayForWindow(window)),
@@ -285,34 +592,51 @@ static SDL_Texture* CreateTexture(SDL_Renderer* r,
 
 static void MoveSprite(void)
 {
+    TRACE_SCOPE("sprites");
     SDL_Rect viewport;
-    SDL_FRect *position, *velocity;
-    int i;
 
     SDL_GetRenderViewport(renderer, &viewport);
 
-    for (i = 0; i < num_sprites; ++i) {
-        position = &positions[i];
-        velocity = &velocities[i];
-        position->x += velocity->x;
-        if ((position->x < 0) || (position->x >= (viewport.w - sprite_w))) {
-            velocity->x = -velocity->x;
-            position->x += velocity->x;
+    /* Large sprite counts are split across the worker pool */
+    UpdateSpriteLayer(sprites, viewport.w, viewport.h, worker_pool);
+
+    /* Blit the sprites onto the screen */
+    RenderSpriteLayer(sprites, renderer, sprite);
+}
+
+/* Present what has been rendered, recording it or taking a snapshot of it first */
+static void PresentRenderer(Sint64 frame_id)
+{
+    SDL_bool record = (video_recorder && VideoRecorderHasRoom(video_recorder));
+    SDL_bool capture = SDL_FALSE;
+
+    ++frames_presented;
+    if (frame_capture &&
+        (capture_requested || (capture_every > 0 && frames_presented % capture_every == 0))) {
+        capture = FrameCaptureHasRoom(frame_capture);
+        capture_requested = SDL_FALSE;
+    }
+
+    if (record || capture) {
+        /* Read back once, the recorder and the capture each get their own surface */
+        Uint64 start = SDL_GetPerformanceCounter();
+        SDL_Surface* surface;
+        {
+            TRACE_SCOPE("read back", frame_id);
+            surface = SDL_RenderReadPixels(renderer, NULL);
         }
-        position->y += velocity->y;
-        if ((position->y < 0) || (position->y >= (viewport.h - sprite_h))) {
-            velocity->y = -velocity->y;
-            position->y += velocity->y;
+        Uint64 read_ticks = SDL_GetPerformanceCounter() - start;
+        if (capture) {
+            SDL_Surface* snapshot = (record && surface) ? SDL_DuplicateSurface(surface) : surface;
+            CaptureFrameSurface(frame_capture, snapshot, frames_presented, read_ticks);
+        }
+        if (record) {
+            RecordFrameSurface(video_recorder, surface, read_ticks);
         }
     }
 
-    /* Blit the sprite onto the screen */
-    for (i = 0; i < num_sprites; ++i) {
-        position = &positions[i];
-
-        /* Blit the sprite onto the screen */
-        SDL_RenderTexture(renderer, sprite, NULL, position);
-    }
+    TRACE_SCOPE("present", frame_id);
+    SDL_RenderPresent(renderer);
 }
 
 static SDL_PixelFormatEnum GetTextureFormat(enum AVPixelFormat format)
@@ -394,41 +718,185 @@ static SDL_bool SupportedPixelFormat(enum AVPixelFormat format)
     return SDL_FALSE;
 }
 
+/* How much work it takes to get a decoded frame into a texture, cheapest first */
+typedef enum PixelFormatCost
+{
+    PIXEL_FORMAT_ZERO_COPY,  /* hardware frames shared with the renderer */
+    PIXEL_FORMAT_NATIVE,     /* uploaded as is, the renderer supports the texture format */
+    PIXEL_FORMAT_CONVERTED,  /* uploaded as is, SDL converts it for the renderer */
+    PIXEL_FORMAT_SWSCALE,    /* converted to ARGB8888 by swscale before uploading */
+    PIXEL_FORMAT_UNSUPPORTED /* hardware frames we can't use */
+} PixelFormatCost;
+
+static const char* pixel_format_cost_names[] = {"zero copy", "native upload",
+                                                 "converted by SDL", "converted by swscale",
+                                                 "unsupported"};
+
+static SDL_bool RendererSupportsTextureFormat(SDL_PixelFormatEnum format)
+{
+    const SDL_PixelFormatEnum* formats = NULL;
+
+    if (renderer) {
+        formats = (const SDL_PixelFormatEnum*)SDL_GetProperty(
+            SDL_GetRendererProperties(renderer), SDL_PROP_RENDERER_TEXTURE_FORMATS_POINTER, NULL);
+    }
+    for (; formats && *formats != SDL_PIXELFORMAT_UNKNOWN; ++formats) {
+        if (*formats == format) {
+            return SDL_TRUE;
+        }
+    }
+    return SDL_FALSE;
+}
+
+static PixelFormatCost GetPixelFormatCost(enum AVPixelFormat format)
+{
+    const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(format);
+
+    if (desc->flags & AV_PIX_FMT_FLAG_HWACCEL) {
+        return SupportedPixelFormat(format) ? PIXEL_FORMAT_ZERO_COPY : PIXEL_FORMAT_UNSUPPORTED;
+    }
+
+    SDL_PixelFormatEnum texture_format = GetTextureFormat(format);
+    if (texture_format == SDL_PIXELFORMAT_UNKNOWN) {
+        /* We support all memory formats using swscale */
+        return PIXEL_FORMAT_SWSCALE;
+    }
+    if (RendererSupportsTextureFormat(texture_format)) {
+        return PIXEL_FORMAT_NATIVE;
+    }
+    return PIXEL_FORMAT_CONVERTED;
+}
+
 static enum AVPixelFormat GetSupportedPixelFormat(AVCodecContext* s,
                                                   const enum AVPixelFormat* pix_fmts)
 {
     const enum AVPixelFormat* p;
+    enum AVPixelFormat best = AV_PIX_FMT_NONE;
+    PixelFormatCost best_cost = PIXEL_FORMAT_UNSUPPORTED;
 
+    /* Take the cheapest format to display, in the decoder's order of preference for a tie */
     for (p = pix_fmts; *p != AV_PIX_FMT_NONE; p++) {
-        const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(*p);
-
-        if (!(desc->flags & AV_PIX_FMT_FLAG_HWACCEL)) {
-            /* We support all memory formats using swscale */
-            break;
-        }
-
-        if (SupportedPixelFormat(*p)) {
-            /* We support this format */
-            break;
+        PixelFormatCost cost = GetPixelFormatCost(*p);
+        if (cost < best_cost) {
+            best = *p;
+            best_cost = cost;
         }
     }
 
-    if (*p == AV_PIX_FMT_NONE) {
+    if (best == AV_PIX_FMT_NONE) {
         SDL_Log("Couldn't find a supported pixel format:\n");
         for (p = pix_fmts; *p != AV_PIX_FMT_NONE; p++) {
             SDL_Log("    %s\n", av_get_pix_fmt_name(*p));
         }
+    } else {
+        SDL_Log("Using pixel format %s, %s\n", av_get_pix_fmt_name(best),
+                pixel_format_cost_names[best_cost]);
+    }
+
+    return best;
+}
+
+static int GetVideoTileLowres(const AVCodec* codec,
+                              const AVCodecParameters* codecpar,
+                              const SDL_Rect* tile)
+{
+    int lowres = 0;
+
+    /* Each lowres step halves the decoded size, stop before going below the tile size */
+    while (lowres < codec->max_lowres && (codecpar->width >> (lowres + 1)) >= tile->w &&
+           (codecpar->height >> (lowres + 1)) >= tile->h) {
+        ++lowres;
+    }
+    return lowres;
+}
+
+static SDL_bool CreateHardwareDevice(AVCodecContext* context, const AVCodecHWConfig* config)
+{
+    int result;
+
+#ifdef SDL_PLATFORM_WIN32
+    if (d3d11_device && config->device_type == AV_HWDEVICE_TYPE_D3D11VA) {
+        AVD3D11VADeviceContext* device_context;
+
+        context->hw_device_ctx = av_hwdevice_ctx_alloc(config->device_type);
+
+        device_context =
+            (AVD3D11VADeviceContext*)((AVHWDeviceContext*)context->hw_device_ctx->data)->hwctx;
+        device_context->device = d3d11_device;
+        device_context->device->AddRef();
+        device_context->device_context = d3d11_context;
+        device_context->device_context->AddRef();
+
+        result = av_hwdevice_ctx_init(context->hw_device_ctx);
+        if (result < 0) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "Couldn't create %s hardware device context: %s",
+                         av_hwdevice_get_type_name(config->device_type), av_err2str(result));
+        } else {
+            SDL_Log("Using %s hardware acceleration with pixel format %s\n",
+                    av_hwdevice_get_type_name(config->device_type),
+                    av_get_pix_fmt_name(config->pix_fmt));
+        }
+    } else
+#endif
+        if (vulkan_context && config->device_type == AV_HWDEVICE_TYPE_VULKAN) {
+        AVVulkanDeviceContext* device_context;
+
+        context->hw_device_ctx = av_hwdevice_ctx_alloc(config->device_type);
+
+        device_context =
+            (AVVulkanDeviceContext*)((AVHWDeviceContext*)context->hw_device_ctx->data)->hwctx;
+        SetupVulkanDeviceContextData(vulkan_context, device_context);
+
+        result = av_hwdevice_ctx_init(context->hw_device_ctx);
+        if (result < 0) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "Couldn't create %s hardware device context: %s",
+                         av_hwdevice_get_type_name(config->device_type), av_err2str(result));
+        } else {
+            SDL_Log("Using %s hardware acceleration with pixel format %s\n",
+                    av_hwdevice_get_type_name(config->device_type),
+                    av_get_pix_fmt_name(config->pix_fmt));
+        }
+    } else {
+        result =
+            av_hwdevice_ctx_create(&context->hw_device_ctx, config->device_type, NULL, NULL, 0);
+        if (result < 0) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "Couldn't create %s hardware device context: %s",
+                         av_hwdevice_get_type_name(config->device_type), av_err2str(result));
+        } else {
+            SDL_Log("Using %s hardware acceleration with pixel format %s\n",
+                    av_hwdevice_get_type_name(config->device_type),
+                    av_get_pix_fmt_name(config->pix_fmt));
+        }
+    }
+
+    if (result < 0) {
+        av_buffer_unref(&context->hw_device_ctx);
+        return SDL_FALSE;
     }
+    return SDL_TRUE;
+}
 
-    return *p;
+static SDL_bool UsableHardwareConfig(const AVCodecHWConfig* config)
+{
+    return ((config->methods & AV_CODEC_HW_CONFIG_METHOD_HW_DEVICE_CTX) &&
+            SupportedPixelFormat(config->pix_fmt));
 }
 
-static AVCodecContext* OpenVideoStream(AVFormatContext* ic, int stream, const AVCodec* codec)
+/* When tile is set the stream is decoded for a video wall tile of that size, on the worker pool */
+static AVCodecContext* OpenVideoStream(AVFormatContext* ic,
+                                       int stream,
+                                       const AVCodec* codec,
+                                       const SDL_Rect* tile)
 {
     AVStream* st = ic->streams[stream];
     AVCodecParameters* codecpar = st->codecpar;
     AVCodecContext* context;
     const AVCodecHWConfig* config;
+    const char* renderer_name = renderer ? SDL_GetRendererName(renderer) : NULL;
+    enum AVHWDeviceType cached_type;
     int i;
     int result;
 
@@ -450,6 +918,20 @@ static AVCodecContext* OpenVideoStream(AVFormatContext* ic, int stream, const AV
     }
     context->pkt_timebase = ic->streams[stream]->time_base;
 
+    /* Try the hardware configuration that worked last time first */
+    if (GetHWConfigCacheWinner(hw_config_cache, codec->name, renderer_name, &cached_type)) {
+        i = 0;
+        while ((config = avcodec_get_hw_config(codec, i++)) != NULL) {
+            if (config->device_type == cached_type && UsableHardwareConfig(config)) {
+                if (!CreateHardwareDevice(context, config)) {
+                    SetHWConfigCacheResult(hw_config_cache, codec->name, renderer_name,
+                                           config->device_type, SDL_FALSE);
+                }
+                break;
+            }
+        }
+    }
+
     /* Look for supported hardware accelerated configurations */
     i = 0;
     while (!context->hw_device_ctx && (config = avcodec_get_hw_config(codec, i++)) != NULL) {
@@ -457,73 +939,31 @@ static AVCodecContext* OpenVideoStream(AVFormatContext* ic, int stream, const AV
         SDL_Log("Found %s hardware acceleration with pixel format %s\n", av_hwdevice_get_type_name(config->device_type), av_get_pix_fmt_name(config->pix_fmt));
 #endif
 
-        if (!(config->methods & AV_CODEC_HW_CONFIG_METHOD_HW_DEVICE_CTX) ||
-            !SupportedPixelFormat(config->pix_fmt)) {
+        if (!UsableHardwareConfig(config)) {
             continue;
         }
 
-#ifdef SDL_PLATFORM_WIN32
-        if (d3d11_device && config->device_type == AV_HWDEVICE_TYPE_D3D11VA) {
-            AVD3D11VADeviceContext* device_context;
-
-            context->hw_device_ctx = av_hwdevice_ctx_alloc(config->device_type);
-
-            device_context =
-                (AVD3D11VADeviceContext*)((AVHWDeviceContext*)context->hw_device_ctx->data)->hwctx;
-            device_context->device = d3d11_device;
-            device_context->device->AddRef();
-            device_context->device_context = d3d11_context;
-            device_context->device_context->AddRef();
-
-            result = av_hwdevice_ctx_init(context->hw_device_ctx);
-            if (result < 0) {
-                SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
-                             "Couldn't create %s hardware device context: %s",
-                             av_hwdevice_get_type_name(config->device_type), av_err2str(result));
-            } else {
-                SDL_Log("Using %s hardware acceleration with pixel format %s\n",
-                        av_hwdevice_get_type_name(config->device_type),
-                        av_get_pix_fmt_name(config->pix_fmt));
-            }
-        } else
-#endif
-            if (vulkan_context && config->device_type == AV_HWDEVICE_TYPE_VULKAN) {
-            AVVulkanDeviceContext* device_context;
-
-            context->hw_device_ctx = av_hwdevice_ctx_alloc(config->device_type);
-
-            device_context =
-                (AVVulkanDeviceContext*)((AVHWDeviceContext*)context->hw_device_ctx->data)->hwctx;
-            SetupVulkanDeviceContextData(vulkan_context, device_context);
-
-            result = av_hwdevice_ctx_init(context->hw_device_ctx);
-            if (result < 0) {
-                SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
-                             "Couldn't create %s hardware device context: %s",
-                             av_hwdevice_get_type_name(config->device_type), av_err2str(result));
-            } else {
-                SDL_Log("Using %s hardware acceleration with pixel format %s\n",
-                        av_hwdevice_get_type_name(config->device_type),
-                        av_get_pix_fmt_name(config->pix_fmt));
-            }
-        } else {
-            result =
-                av_hwdevice_ctx_create(&context->hw_device_ctx, config->device_type, NULL, NULL, 0);
-            if (result < 0) {
-                SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
-                             "Couldn't create %s hardware device context: %s",
-                             av_hwdevice_get_type_name(config->device_type), av_err2str(result));
-            } else {
-                SDL_Log("Using %s hardware acceleration with pixel format %s\n",
-                        av_hwdevice_get_type_name(config->device_type),
-                        av_get_pix_fmt_name(config->pix_fmt));
+        if (IsHWConfigCacheFailure(hw_config_cache, codec->name, renderer_name,
+                                   config->device_type)) {
+            if (verbose) {
+                SDL_Log("Skipping %s hardware acceleration, it failed before\n",
+                        av_hwdevice_get_type_name(config->device_type));
             }
+            continue;
         }
+
+        SetHWConfigCacheResult(hw_config_cache, codec->name, renderer_name, config->device_type,
+                               CreateHardwareDevice(context, config));
     }
+    SaveHWConfigCache(hw_config_cache);
 
     /* Allow supported hardware accelerated pixel formats */
     context->get_format = GetSupportedPixelFormat;
 
+    if (use_hugepages) {
+        SetupHugePageCodecContext(context);
+    }
+
     if (codecpar->codec_id == AV_CODEC_ID_VVC) {
         context->strict_std_compliance = -2;
 
@@ -532,7 +972,39 @@ static AVCodecContext* OpenVideoStream(AVFormatContext* ic, int stream, const AV
         context->thread_type = (FF_THREAD_FRAME | FF_THREAD_SLICE);
     }
 
+    if (low_latency) {
+        /* Frame threading holds back a frame per thread, slice threading doesn't */
+        context->flags |= AV_CODEC_FLAG_LOW_DELAY;
+        context->thread_type = FF_THREAD_SLICE;
+    }
+
+    if (IsTraceEnabled()) {
+        /* Carry the packet trace IDs through to the decoded frames */
+        context->flags |= AV_CODEC_FLAG_COPY_OPAQUE;
+    }
+
+    if (tile) {
+        /* Tiles are decoded in parallel with each other on the worker pool, so each decoder is
+         * single threaded rather than owning threads of its own. A tile gets no parallelism
+         * within a frame, libavcodec replaces a custom execute() with its own slice threads
+         * whenever thread_count is above 1.
+         */
+        context->thread_count = 1;
+
+        context->lowres = GetVideoTileLowres(codec, codecpar, tile);
+        if (context->lowres) {
+            SDL_Log("Decoding at lowres %d for a %dx%d tile\n", context->lowres, tile->w,
+                    tile->h);
+        }
+    }
+
+    /* Codec threads are created when the codec is opened and inherit our affinity */
+    CPUMask cpus;
+    SDL_bool pinned = GetCurrentThreadAffinity(&cpus) && PinCurrentThread(CPU_THREAD_DECODE);
     result = avcodec_open2(context, codec, NULL);
+    if (pinned) {
+        SetCurrentThreadAffinity(&cpus);
+    }
     if (result < 0) {
         SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Couldn't open codec %s: %s",
                      avcodec_get_name(context->codec_id), av_err2str(result));
@@ -540,8 +1012,10 @@ static AVCodecContext* OpenVideoStream(AVFormatContext* ic, int stream, const AV
         return NULL;
     }
 
-    SDL_SetWindowSize(window, codecpar->width, codecpar->height);
-    SDL_SetWindowPosition(window, SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED);
+    if (!tile) {
+        SDL_SetWindowSize(window, codecpar->width, codecpar->height);
+        SDL_SetWindowPosition(window, SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED);
+    }
 
     return context;
 }
@@ -630,6 +1104,34 @@ static void SDLCALL FreeSwsContextContainer(void* userdata, void* value)
     SDL_free(sws_container);
 }
 
+/* Get the planes of a YUV frame top row first in memory. Frames stored bottom up are uploaded
+ * that way and flipped when the texture is drawn, so every plane has to be stored the same way.
+ */
+static SDL_bool GetFramePlanes(AVFrame* frame, int num_planes, const Uint8** planes, int* pitches)
+{
+    const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(static_cast<AVPixelFormat>(frame->format));
+    SDL_bool flipped = (frame->linesize[0] < 0) ? SDL_TRUE : SDL_FALSE;
+
+    for (int i = 0; i < num_planes; ++i) {
+        if ((frame->linesize[i] < 0) != flipped) {
+            SDL_SetError("Frame planes are stored in different directions");
+            return SDL_FALSE;
+        }
+
+        planes[i] = frame->data[i];
+        pitches[i] = frame->linesize[i];
+        if (flipped) {
+            int rows = frame->height;
+            if (i > 0) {
+                rows = AV_CEIL_RSHIFT(frame->height, desc->log2_chroma_h);
+            }
+            planes[i] += frame->linesize[i] * (rows - 1);
+            pitches[i] = -frame->linesize[i];
+        }
+    }
+    return SDL_TRUE;
+}
+
 static SDL_bool GetTextureForMemoryFrame(AVFrame* frame, SDL_Texture** texture)
 {
     int texture_width = 0, texture_height = 0;
@@ -703,21 +1205,28 @@ static SDL_bool GetTextureForMemoryFrame(AVFrame* frame, SDL_Texture** texture)
             }
             break;
         }
-        case SDL_PIXELFORMAT_IYUV:
-            if (frame->linesize[0] > 0 && frame->linesize[1] > 0 && frame->linesize[2] > 0) {
-                SDL_UpdateYUVTexture(*texture, NULL, frame->data[0], frame->linesize[0],
-                                     frame->data[1], frame->linesize[1], frame->data[2],
-                                     frame->linesize[2]);
-            } else if (frame->linesize[0] < 0 && frame->linesize[1] < 0 && frame->linesize[2] < 0) {
-                SDL_UpdateYUVTexture(
-                    *texture, NULL, frame->data[0] + frame->linesize[0] * (frame->height - 1),
-                    -frame->linesize[0],
-                    frame->data[1] + frame->linesize[1] * (AV_CEIL_RSHIFT(frame->height, 1) - 1),
-                    -frame->linesize[1],
-                    frame->data[2] + frame->linesize[2] * (AV_CEIL_RSHIFT(frame->height, 1) - 1),
-                    -frame->linesize[2]);
+        case SDL_PIXELFORMAT_IYUV: {
+            const Uint8* planes[3];
+            int pitches[3];
+            if (!GetFramePlanes(frame, 3, planes, pitches)) {
+                return SDL_FALSE;
+            }
+            SDL_UpdateYUVTexture(*texture, NULL, planes[0], pitches[0], planes[1], pitches[1],
+                                 planes[2], pitches[2]);
+            break;
+        }
+        case SDL_PIXELFORMAT_NV12:
+        case SDL_PIXELFORMAT_NV21:
+        case SDL_PIXELFORMAT_P010: {
+            /* The luma and interleaved chroma planes aren't contiguous in an AVFrame */
+            const Uint8* planes[2];
+            int pitches[2];
+            if (!GetFramePlanes(frame, 2, planes, pitches)) {
+                return SDL_FALSE;
             }
+            SDL_UpdateNVTexture(*texture, NULL, planes[0], pitches[0], planes[1], pitches[1]);
             break;
+        }
         default:
             if (frame->linesize[0] < 0) {
                 SDL_UpdateTexture(*texture, NULL,
@@ -1138,6 +1647,8 @@ static SDL_bool GetTextureForVulkanFrame(AVFrame* frame, SDL_Texture** texture)
 
 static SDL_bool GetTextureForFrame(AVFrame* frame, SDL_Texture** texture)
 {
+    TRACE_SCOPE("upload", GetFrameTraceID(frame));
+
     switch (frame->format) {
         case AV_PIX_FMT_VAAPI:
             return GetTextureForVAAPIFrame(frame, texture);
@@ -1170,25 +1681,29 @@ static int FinishFrameRendering(AVFrame* frame)
     return 0;
 }
 
-static void DisplayVideoTexture(AVFrame* frame)
+static void RenderVideoTexture(AVFrame* frame, SDL_Texture* texture)
 {
-    /* Update the video texture */
-    if (!GetTextureForFrame(frame, &video_texture)) {
-        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Couldn't get texture for frame: %s\n",
-                     SDL_GetError());
-        return;
-    }
-
     SDL_FRect src;
     src.x = 0.0f;
     src.y = 0.0f;
     src.w = (float)frame->width;
     src.h = (float)frame->height;
     if (frame->linesize[0] < 0) {
-        SDL_RenderTextureRotated(renderer, video_texture, &src, NULL, 0.0, NULL, SDL_FLIP_VERTICAL);
+        SDL_RenderTextureRotated(renderer, texture, &src, NULL, 0.0, NULL, SDL_FLIP_VERTICAL);
     } else {
-        SDL_RenderTexture(renderer, video_texture, &src, NULL);
+        SDL_RenderTexture(renderer, texture, &src, NULL);
+    }
+}
+
+static void DisplayVideoTexture(AVFrame* frame)
+{
+    /* Update the video texture */
+    if (!GetTextureForFrame(frame, &video_texture)) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Couldn't get texture for frame: %s\n",
+                     SDL_GetError());
+        return;
     }
+    RenderVideoTexture(frame, video_texture);
 }
 
 static void DisplayVideoFrame(AVFrame* frame)
@@ -1196,40 +1711,652 @@ static void DisplayVideoFrame(AVFrame* frame)
     DisplayVideoTexture(frame);
 }
 
-static void HandleVideoFrame(AVFrame* frame, double pts)
+static void AddVideoStageTime(VideoStage stage, Uint64 start, int frames)
+{
+    video_stage_ticks[stage] += SDL_GetPerformanceCounter() - start;
+    video_stage_frames[stage] += frames;
+}
+
+static void GetVideoStageTimes(double stage_ms[VIDEO_STAGE_COUNT])
 {
-    /* Quick and dirty PTS handling */
-    if (!video_start) {
-        video_start = SDL_GetTicks();
+    for (int i = 0; i < VIDEO_STAGE_COUNT; ++i) {
+        stage_ms[i] = (double)video_stage_ticks[i] * 1000.0 / SDL_GetPerformanceFrequency();
     }
-    double now = (double)(SDL_GetTicks() - video_start) / 1000.0;
-    while (now < pts - 0.001) {
-        SDL_Delay(1);
-        now = (double)(SDL_GetTicks() - video_start) / 1000.0;
+    if (video_filter) {
+        GetVideoFilterStats(video_filter, &video_stage_frames[VIDEO_STAGE_FILTER],
+                            &stage_ms[VIDEO_STAGE_FILTER]);
     }
+}
 
-    if (BeginFrameRendering(frame) < 0) {
+static void LogVideoStageStats(void)
+{
+    double stage_ms[VIDEO_STAGE_COUNT];
+
+    GetVideoStageTimes(stage_ms);
+    if (video_stage_frames[VIDEO_STAGE_RENDER] == 0) {
         return;
     }
 
-    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
-    SDL_RenderClear(renderer);
+    SDL_Log("Video stages:\n");
+    for (int i = 0; i < VIDEO_STAGE_COUNT; ++i) {
+        if (video_stage_frames[i] == 0) {
+            continue;
+        }
+        double ms = stage_ms[i];
+        SDL_Log("    %-8s %6d frames, %10.2f ms, %6.2f ms/frame\n", video_stage_names[i],
+                video_stage_frames[i], ms, ms / video_stage_frames[i]);
+    }
+}
 
-    DisplayVideoFrame(frame);
+static double GetPlaybackTime(void)
+{
+    return clock_pts + (double)(SDL_GetTicks() - clock_ticks) * playback_speed / 1000.0;
+}
 
-    /* Render any bouncing balls */
-    MoveSprite();
+/* Decide how much of the video to decode, from how far it is behind the playback clock */
+static void UpdateVideoFrameSkipping(AVCodecContext* context, double pts)
+{
+    enum AVDiscard skip = AVDISCARD_DEFAULT;
 
-    SDL_RenderPresent(renderer);
+    if (!clock_ticks || playback_speed <= 1.0) {
+        context->skip_frame = skip;
+        return;
+    }
+    if (playback_speed >= 2.0) {
+        /* Most of these won't be shown, and nothing else needs them to be decoded */
+        skip = AVDISCARD_NONREF;
+    }
+    if (GetPlaybackTime() - pts > VIDEO_SKIP_TO_KEYFRAME_S) {
+        /* Too far behind to catch up frame by frame */
+        skip = AVDISCARD_NONKEY;
+    }
+    context->skip_frame = skip;
+}
 
-    FinishFrameRendering(frame);
+static void HandleMainEvent(const SDL_Event* event)
+{
+    if (wake_event_type && event->type == wake_event_type) {
+        SDL_AtomicSet(&wake_pending, 0);
+    } else if (event->type == SDL_EVENT_QUIT ||
+               (event->type == SDL_EVENT_KEY_DOWN && event->key.keysym.sym == SDLK_ESCAPE)) {
+        done = 1;
+    } else if (event->type == SDL_EVENT_KEY_DOWN && !video_tiles) {
+        switch (event->key.keysym.sym) {
+            case SDLK_LEFTBRACKET:
+                --pending_input.speed_steps;
+                break;
+            case SDLK_RIGHTBRACKET:
+                ++pending_input.speed_steps;
+                break;
+            case SDLK_BACKSPACE:
+                pending_input.reset_speed = SDL_TRUE;
+                pending_input.speed_steps = 0;
+                break;
+            case SDLK_SPACE:
+                pending_input.toggle_pause = !pending_input.toggle_pause;
+                break;
+            case SDLK_LEFT:
+                --pending_input.frame_steps;
+                break;
+            case SDLK_RIGHT:
+                ++pending_input.frame_steps;
+                break;
+            case SDLK_c:
+                pending_input.capture = SDL_TRUE;
+                break;
+            default:
+                break;
+        }
+    }
 }
 
-static AVCodecContext* OpenAudioStream(AVFormatContext* ic, int stream, const AVCodec* codec)
+/* Sleep until an event comes in or timeout_ms passes, -1 waits for an event */
+static void WaitForMainLoop(Sint32 timeout_ms)
 {
-    AVStream* st = ic->streams[stream];
-    AVCodecParameters* codecpar = st->codecpar;
-    AVCodecContext* context;
+    SDL_Event event;
+
+    if (SDL_WaitEventTimeout(&event, timeout_ms)) {
+        HandleMainEvent(&event);
+        while (SDL_PollEvent(&event)) {
+            HandleMainEvent(&event);
+        }
+    }
+}
+
+/* Safe to call from any thread, repeated calls before the main loop wakes are coalesced */
+static void WakeMainLoop(void)
+{
+    if (wake_event_type && SDL_AtomicSet(&wake_pending, 1) == 0) {
+        SDL_Event event;
+        SDL_zero(event);
+        event.type = wake_event_type;
+        SDL_PushEvent(&event);
+    }
+}
+
+/* The shorter of two main loop timeouts, where -1 is forever */
+static Sint32 GetShorterTimeout(Sint32 a, Sint32 b)
+{
+    if (a < 0) {
+        return b;
+    }
+    if (b < 0) {
+        return a;
+    }
+    return SDL_min(a, b);
+}
+
+static void AddLatencySample(LatencyStats* stats, Sint64 ms)
+{
+    if (stats->frames == 0 || ms < stats->min_ms) {
+        stats->min_ms = ms;
+    }
+    if (stats->frames == 0 || ms > stats->max_ms) {
+        stats->max_ms = ms;
+    }
+    stats->total_ms += ms;
+    ++stats->frames;
+}
+
+static void LogLatencyStats(const char* label, const LatencyStats* stats)
+{
+    if (stats->frames == 0) {
+        SDL_Log("%s: no frames with a timestamp pattern\n", label);
+        return;
+    }
+    SDL_Log("%s: %" SDL_PRIs64 " ms min, %.1f ms avg, %" SDL_PRIs64 " ms max over %d frames\n",
+            label, stats->min_ms, (double)stats->total_ms / stats->frames, stats->max_ms,
+            stats->frames);
+}
+
+/* Read the timestamp pattern of a frame that was just presented, and log the latency */
+static void MeasureVideoLatency(const AVFrame* frame)
+{
+    Sint64 ms;
+
+    if (ReadTimestampPattern(frame, &ms)) {
+        Sint64 age = GetTimestampAgeMS(ms);
+        AddLatencySample(&latency_interval, age);
+        AddLatencySample(&latency_total, age);
+    }
+
+    Uint64 now = SDL_GetTicks();
+    if (now >= next_latency_report) {
+        if (latency_interval.frames > 0) {
+            LogLatencyStats("Latency", &latency_interval);
+        }
+        SDL_zero(latency_interval);
+        next_latency_report = now + LATENCY_REPORT_INTERVAL_MS;
+    }
+}
+
+static void HandleVideoFrame(AVFrame* frame, double pts)
+{
+    /* Quick and dirty PTS handling, the clock starts with the first frame after a pause too */
+    if (!clock_ticks) {
+        clock_ticks = SDL_GetTicks();
+        clock_pts = pts;
+    }
+    double now = GetPlaybackTime();
+    if (playback_speed > 1.0 && now - pts > VIDEO_LATE_FRAME_S) {
+        /* Don't spend time rendering a frame that's already late */
+        ++video_frames_skipped;
+        return;
+    }
+    while (!benchmark_file && !low_latency && !done && now < pts - 0.001) {
+        /* Sleep until the frame is due, reading input as it comes in */
+        WaitForMainLoop((Sint32)SDL_ceil((pts - now) * 1000.0 / playback_speed));
+        now = GetPlaybackTime();
+    }
+
+    Uint64 start = SDL_GetPerformanceCounter();
+    if (BeginFrameRendering(frame) < 0) {
+        return;
+    }
+
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+    SDL_RenderClear(renderer);
+
+    DisplayVideoFrame(frame);
+
+    /* Render any bouncing balls */
+    MoveSprite();
+
+    PresentRenderer(GetFrameTraceID(frame));
+    FinishStartup();
+
+    FinishFrameRendering(frame);
+    AddVideoStageTime(VIDEO_STAGE_RENDER, start, 1);
+
+    if (low_latency) {
+        MeasureVideoLatency(frame);
+    }
+}
+
+static void GetVideoTileRect(int index, const SDL_Rect* viewport, SDL_FRect* rect)
+{
+    int columns = (int)SDL_ceil(SDL_sqrt((double)num_video_tiles));
+    int rows = (num_video_tiles + columns - 1) / columns;
+
+    rect->w = (float)viewport->w / columns;
+    rect->h = (float)viewport->h / rows;
+    rect->x = (index % columns) * rect->w;
+    rect->y = (index / columns) * rect->h;
+}
+
+static AVFrame* ScaleVideoTileFrame(VideoTile* tile, AVFrame* frame, int max_width, int max_height)
+{
+    enum AVPixelFormat format = static_cast<AVPixelFormat>(frame->format);
+    float scale;
+    int width, height;
+
+    if (frame->width <= 2 * max_width && frame->height <= 2 * max_height) {
+        /* Close enough, let the renderer scale it */
+        return frame;
+    }
+
+    scale = SDL_min((float)max_width / frame->width, (float)max_height / frame->height);
+    width = SDL_max((int)(frame->width * scale) & ~1, 2);
+    height = SDL_max((int)(frame->height * scale) & ~1, 2);
+
+    /* Keep the decoded format when we can upload it directly, it's smaller than BGRA */
+    if (GetTextureFormat(format) == SDL_PIXELFORMAT_UNKNOWN || !sws_isSupportedOutput(format)) {
+        format = AV_PIX_FMT_BGRA;
+    }
+
+    tile->sws_context =
+        sws_getCachedContext(tile->sws_context, frame->width, frame->height,
+                             static_cast<AVPixelFormat>(frame->format), width, height, format,
+                             SWS_FAST_BILINEAR, NULL, NULL, NULL);
+    if (!tile->sws_context) {
+        return frame;
+    }
+
+    tile->scaled->format = format;
+    tile->scaled->width = width;
+    tile->scaled->height = height;
+    if (av_frame_get_buffer(tile->scaled, 0) < 0) {
+        return frame;
+    }
+    sws_scale(tile->sws_context, (const uint8_t* const*)frame->data, frame->linesize, 0,
+              frame->height, tile->scaled->data, tile->scaled->linesize);
+    av_frame_copy_props(tile->scaled, frame);
+    return tile->scaled;
+}
+
+static void DecodeVideoTile(void* userdata)
+{
+    TRACE_SCOPE("tile decode");
+    VideoTile* tile = (VideoTile*)userdata;
+    AVCodecContext* context = tile->video_context;
+    int max_width, max_height;
+    SDL_bool full;
+    SDL_bool finished = SDL_FALSE;
+    int result;
+
+    /* Decode until the tile's frame queue is full, then give the thread back to the pool */
+    for (;;) {
+        SDL_LockMutex(tile->lock);
+        full = (tile->queue_count == VIDEO_TILE_QUEUE_SIZE);
+        max_width = tile->max_width;
+        max_height = tile->max_height;
+        SDL_UnlockMutex(tile->lock);
+        if (full) {
+            break;
+        }
+
+        result = avcodec_receive_frame(context, tile->decoded);
+        if (result >= 0) {
+            AVFrame* frame = ScaleVideoTileFrame(tile, tile->decoded, max_width, max_height);
+
+            SDL_LockMutex(tile->lock);
+            int index = (tile->queue_head + tile->queue_count) % VIDEO_TILE_QUEUE_SIZE;
+            av_frame_move_ref(tile->queue[index], frame);
+            SDL_bool was_empty = (tile->queue_count == 0);
+            ++tile->queue_count;
+            SDL_UnlockMutex(tile->lock);
+
+            if (was_empty) {
+                /* The render thread may be waiting for this */
+                WakeMainLoop();
+            }
+
+            av_frame_unref(tile->decoded);
+            continue;
+        }
+        if (result != AVERROR(EAGAIN) || tile->flushing) {
+            if (result != AVERROR_EOF) {
+                SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "avcodec_receive_frame(%s) failed: %s",
+                             tile->file, av_err2str(result));
+            }
+            finished = SDL_TRUE;
+            break;
+        }
+
+        /* The decoder needs more data */
+        result = av_read_frame(tile->ic, tile->pkt);
+        if (result < 0) {
+            /* End of stream, drain the decoder */
+            avcodec_send_packet(context, NULL);
+            tile->flushing = SDL_TRUE;
+            continue;
+        }
+        if (tile->pkt->stream_index == tile->video_stream) {
+            result = avcodec_send_packet(context, tile->pkt);
+            if (result < 0) {
+                SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "avcodec_send_packet(%s) failed: %s",
+                             tile->file, av_err2str(result));
+            }
+        }
+        av_packet_unref(tile->pkt);
+    }
+
+    SDL_LockMutex(tile->lock);
+    if (finished) {
+        tile->finished = SDL_TRUE;
+    }
+    tile->decoding = SDL_FALSE;
+    SDL_UnlockMutex(tile->lock);
+
+    if (finished) {
+        WakeMainLoop();
+    }
+}
+
+static SDL_bool OpenVideoTile(VideoTile* tile, const SDL_Rect* rect, const char* video_codec_name)
+{
+    const AVCodec* codec = NULL;
+    SDL_bool queue_allocated = SDL_TRUE;
+    int result;
+
+    for (int i = 0; i < VIDEO_TILE_QUEUE_SIZE; ++i) {
+        tile->queue[i] = av_frame_alloc();
+        if (!tile->queue[i]) {
+            queue_allocated = SDL_FALSE;
+        }
+    }
+    tile->lock = SDL_CreateMutex();
+    tile->pkt = av_packet_alloc();
+    tile->decoded = av_frame_alloc();
+    tile->scaled = av_frame_alloc();
+    tile->current = av_frame_alloc();
+    if (!queue_allocated || !tile->lock || !tile->pkt || !tile->decoded || !tile->scaled ||
+        !tile->current) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Out of memory!\n");
+        return SDL_FALSE;
+    }
+    tile->max_width = rect->w;
+    tile->max_height = rect->h;
+    tile->first_pts = -1.0;
+
+    result = avformat_open_input(&tile->ic, tile->file, NULL, NULL);
+    if (result < 0) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Couldn't open %s: %d", tile->file, result);
+        return SDL_FALSE;
+    }
+    tile->video_stream = av_find_best_stream(tile->ic, AVMEDIA_TYPE_VIDEO, -1, -1, &codec, 0);
+    if (tile->video_stream < 0) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Couldn't find a video stream in %s",
+                     tile->file);
+        return SDL_FALSE;
+    }
+    if (video_codec_name) {
+        codec = avcodec_find_decoder_by_name(video_codec_name);
+        if (!codec) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Couldn't find codec '%s'",
+                         video_codec_name);
+            return SDL_FALSE;
+        }
+    }
+
+    /* Tiles are silent, don't spend time demuxing anything but the video */
+    for (unsigned int i = 0; i < tile->ic->nb_streams; ++i) {
+        if ((int)i != tile->video_stream) {
+            tile->ic->streams[i]->discard = AVDISCARD_ALL;
+        }
+    }
+
+    tile->video_context = OpenVideoStream(tile->ic, tile->video_stream, codec, rect);
+    if (!tile->video_context) {
+        return SDL_FALSE;
+    }
+    return SDL_TRUE;
+}
+
+static void CloseVideoTile(VideoTile* tile)
+{
+    SDL_DestroyTexture(tile->texture);
+    av_frame_free(&tile->current);
+    for (int i = 0; i < VIDEO_TILE_QUEUE_SIZE; ++i) {
+        av_frame_free(&tile->queue[i]);
+    }
+    av_frame_free(&tile->scaled);
+    av_frame_free(&tile->decoded);
+    av_packet_free(&tile->pkt);
+    sws_freeContext(tile->sws_context);
+    avcodec_free_context(&tile->video_context);
+    avformat_close_input(&tile->ic);
+    if (tile->lock) {
+        SDL_DestroyMutex(tile->lock);
+    }
+}
+
+static SDL_bool OpenVideoWall(const char** files, int num_files, const char* video_codec_name)
+{
+    SDL_Rect viewport;
+
+    video_tiles = (VideoTile*)SDL_calloc(num_files, sizeof(*video_tiles));
+    if (!video_tiles) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Out of memory!\n");
+        return SDL_FALSE;
+    }
+    num_video_tiles = num_files;
+
+    SDL_GetRenderViewport(renderer, &viewport);
+    for (int i = 0; i < num_video_tiles; ++i) {
+        VideoTile* tile = &video_tiles[i];
+        SDL_FRect frect;
+        SDL_Rect rect;
+
+        GetVideoTileRect(i, &viewport, &frect);
+        rect.x = (int)frect.x;
+        rect.y = (int)frect.y;
+        rect.w = (int)frect.w;
+        rect.h = (int)frect.h;
+
+        tile->file = files[i];
+        if (!OpenVideoTile(tile, &rect, video_codec_name)) {
+            return SDL_FALSE;
+        }
+    }
+
+    SDL_Log("Video wall: %d streams, %d decode threads\n", num_video_tiles,
+            GetWorkerPoolThreadCount(worker_pool));
+    return SDL_TRUE;
+}
+
+static void CloseVideoWall(void)
+{
+    if (video_tiles) {
+        for (int i = 0; i < num_video_tiles; ++i) {
+            CloseVideoTile(&video_tiles[i]);
+        }
+        SDL_free(video_tiles);
+        video_tiles = NULL;
+    }
+    num_video_tiles = 0;
+}
+
+/* Show the newest frame that is due, returns SDL_TRUE if the tile texture changed.
+ * timeout_ms is shortened to when the next queued frame is due.
+ */
+static SDL_bool UpdateVideoTile(VideoTile* tile, const SDL_FRect* rect, Sint32* timeout_ms)
+{
+    AVRational time_base = tile->video_context->pkt_timebase;
+    SDL_bool updated = SDL_FALSE;
+    SDL_bool submit = SDL_FALSE;
+    double now = 0.0;
+
+    if (tile->start) {
+        now = (double)(SDL_GetTicks() - tile->start) / 1000.0;
+    }
+
+    SDL_LockMutex(tile->lock);
+    tile->max_width = (int)rect->w;
+    tile->max_height = (int)rect->h;
+    while (tile->queue_count > 0) {
+        AVFrame* frame = tile->queue[tile->queue_head];
+        double pts = ((double)frame->pts * time_base.num) / time_base.den;
+
+        if (tile->first_pts < 0.0) {
+            tile->first_pts = pts;
+            tile->start = SDL_GetTicks();
+            now = 0.0;
+        }
+        if (pts - tile->first_pts > now) {
+            Sint32 due_ms = (Sint32)SDL_ceil((pts - tile->first_pts - now) * 1000.0);
+            *timeout_ms = GetShorterTimeout(*timeout_ms, due_ms);
+            break;
+        }
+
+        /* Frames we were too late for are dropped here without being uploaded */
+        av_frame_unref(tile->current);
+        av_frame_move_ref(tile->current, frame);
+        tile->queue_head = (tile->queue_head + 1) % VIDEO_TILE_QUEUE_SIZE;
+        --tile->queue_count;
+        updated = SDL_TRUE;
+    }
+    if (!tile->decoding && !tile->finished && tile->queue_count < VIDEO_TILE_QUEUE_SIZE) {
+        tile->decoding = SDL_TRUE;
+        submit = SDL_TRUE;
+    }
+    SDL_UnlockMutex(tile->lock);
+
+    if (submit && !SubmitWorkerTask(worker_pool, DecodeVideoTile, tile)) {
+        SDL_LockMutex(tile->lock);
+        tile->decoding = SDL_FALSE;
+        SDL_UnlockMutex(tile->lock);
+    }
+
+    if (updated && !GetTextureForFrame(tile->current, &tile->texture)) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Couldn't get texture for frame: %s\n",
+                     SDL_GetError());
+    }
+    return updated;
+}
+
+static void RenderVideoTile(VideoTile* tile, const SDL_FRect* rect)
+{
+    AVFrame* frame = tile->current;
+    SDL_FRect src, dst;
+    float scale;
+
+    if (!tile->texture || !frame->width || !frame->height) {
+        return;
+    }
+
+    src.x = 0.0f;
+    src.y = 0.0f;
+    src.w = (float)frame->width;
+    src.h = (float)frame->height;
+
+    /* Fit the frame in the tile, keeping its aspect ratio */
+    scale = SDL_min(rect->w / src.w, rect->h / src.h);
+    dst.w = src.w * scale;
+    dst.h = src.h * scale;
+    dst.x = rect->x + (rect->w - dst.w) / 2;
+    dst.y = rect->y + (rect->h - dst.h) / 2;
+
+    if (frame->linesize[0] < 0) {
+        SDL_RenderTextureRotated(renderer, tile->texture, &src, &dst, 0.0, NULL,
+                                 SDL_FLIP_VERTICAL);
+    } else {
+        SDL_RenderTexture(renderer, tile->texture, &src, &dst);
+    }
+}
+
+/* Returns how long the main loop can sleep, -1 to wait for a decode task to wake it */
+static Sint32 UpdateVideoWall(void)
+{
+    SDL_Rect viewport;
+    SDL_FRect rect;
+    SDL_bool updated = SDL_FALSE;
+    SDL_bool playing = SDL_FALSE;
+    Sint32 timeout_ms = -1;
+    int i;
+
+    SDL_GetRenderViewport(renderer, &viewport);
+
+    for (i = 0; i < num_video_tiles; ++i) {
+        VideoTile* tile = &video_tiles[i];
+
+        GetVideoTileRect(i, &viewport, &rect);
+        if (UpdateVideoTile(tile, &rect, &timeout_ms)) {
+            updated = SDL_TRUE;
+        }
+
+        SDL_LockMutex(tile->lock);
+        if (!tile->finished || tile->queue_count > 0) {
+            playing = SDL_TRUE;
+        }
+        SDL_UnlockMutex(tile->lock);
+    }
+
+    if (!playing) {
+        done = 1;
+        return 0;
+    }
+    if (num_sprites > 0 || (timeout_ms < 0 && !wake_event_type)) {
+        /* The sprites move every frame, or nothing can wake us, presenting sets the pace */
+        timeout_ms = 0;
+    }
+
+    if (!updated && num_sprites == 0) {
+        /* Nothing new to show, wait for the next frame or the decode tasks */
+        return timeout_ms;
+    }
+
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+    SDL_RenderClear(renderer);
+
+    for (i = 0; i < num_video_tiles; ++i) {
+        GetVideoTileRect(i, &viewport, &rect);
+        RenderVideoTile(&video_tiles[i], &rect);
+    }
+
+    /* Render any bouncing balls */
+    MoveSprite();
+
+    PresentRenderer(0);
+    if (updated) {
+        FinishStartup();
+    }
+    return timeout_ms;
+}
+
+static void SDLCALL PinAudioThread(void* userdata,
+                                    const SDL_AudioSpec* spec,
+                                    float* buffer,
+                                    int buflen)
+{
+    SDL_AtomicInt* pinned = (SDL_AtomicInt*)userdata;
+
+    (void)spec;
+    (void)buffer;
+    (void)buflen;
+
+    /* This runs on the audio device thread, which SDL doesn't give us any other handle to */
+    if (SDL_AtomicCompareAndSwap(pinned, 0, 1)) {
+        PinCurrentThread(CPU_THREAD_AUDIO);
+        SetTraceThreadName("audio");
+    }
+}
+
+static AVCodecContext* OpenAudioStream(AVFormatContext* ic, int stream, const AVCodec* codec)
+{
+    AVStream* st = ic->streams[stream];
+    AVCodecParameters* codecpar = st->codecpar;
+    AVCodecContext* context;
     int result;
 
     SDL_Log("Audio stream: %s %d channels, %d Hz\n", avcodec_get_name(codec->id),
@@ -1248,150 +2375,730 @@ static AVCodecContext* OpenAudioStream(AVFormatContext* ic, int stream, const AV
         avcodec_free_context(&context);
         return NULL;
     }
-    context->pkt_timebase = ic->streams[stream]->time_base;
+    context->pkt_timebase = ic->streams[stream]->time_base;
+    if (IsTraceEnabled()) {
+        context->flags |= AV_CODEC_FLAG_COPY_OPAQUE;
+    }
+
+    result = avcodec_open2(context, codec, NULL);
+    if (result < 0) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Couldn't open codec %s: %s",
+                     avcodec_get_name(context->codec_id), av_err2str(result));
+        avcodec_free_context(&context);
+        return NULL;
+    }
+
+    if (benchmark_file) {
+        /* The audio is only decoded, there's nothing to play it at the benchmark's pace */
+        return context;
+    }
+
+    /* Mix surround sound down to the device channels ourselves, before it's queued */
+    SDL_AudioSpec device_spec;
+    if (SDL_GetAudioDeviceFormat(SDL_AUDIO_DEVICE_DEFAULT_PLAYBACK, &device_spec, NULL) < 0) {
+        device_spec.channels = 0;
+    }
+    audio_ring = CreateAudioRing(&codecpar->ch_layout, device_spec.channels,
+                                 codecpar->sample_rate, AUDIO_RING_CAPACITY_MS);
+    if (!audio_ring) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Out of memory!\n");
+        avcodec_free_context(&context);
+        return NULL;
+    }
+
+    /* The device buffer is the output latency, the callback pulls from the ring to fill it */
+    char sample_frames[32];
+    SDL_snprintf(sample_frames, sizeof(sample_frames), "%d",
+                 SDL_max(codecpar->sample_rate * audio_latency_ms / 1000, 1));
+    SDL_SetHint(SDL_HINT_AUDIO_DEVICE_SAMPLE_FRAMES, sample_frames);
+
+    SDL_AudioSpec spec = {SDL_AUDIO_F32, GetAudioRingChannels(audio_ring),
+                          codecpar->sample_rate};
+    if (spec.channels != codecpar->ch_layout.nb_channels) {
+        SDL_Log("Downmixing %d channels to %d\n", codecpar->ch_layout.nb_channels, spec.channels);
+    }
+    audio = SDL_OpenAudioDeviceStream(SDL_AUDIO_DEVICE_DEFAULT_PLAYBACK, &spec,
+                                      AudioRingStreamCallback, audio_ring);
+    if (audio) {
+        static SDL_AtomicInt audio_thread_pinned;
+
+        SDL_SetAudioPostmixCallback(SDL_GetAudioStreamDevice(audio), PinAudioThread,
+                                    &audio_thread_pinned);
+        SDL_ResumeAudioDevice(SDL_GetAudioStreamDevice(audio));
+    } else {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Couldn't open audio: %s", SDL_GetError());
+    }
+    return context;
+}
+
+static int SDLCALL OpenAudioStreamThread(void* data)
+{
+    AudioOpenData* open_data = (AudioOpenData*)data;
+
+    BeginStartupStep(STARTUP_AUDIO);
+    open_data->context = OpenAudioStream(open_data->ic, open_data->stream, open_data->codec);
+    EndStartupStep(STARTUP_AUDIO);
+    return 0;
+}
+
+static void StartOpenAudioStream(AVFormatContext* ic, int stream, const AVCodec* codec)
+{
+    audio_open.ic = ic;
+    audio_open.stream = stream;
+    audio_open.codec = codec;
+    audio_open.context = NULL;
+    audio_open_thread = SDL_CreateThread(OpenAudioStreamThread, "audio_open", &audio_open);
+    if (!audio_open_thread) {
+        OpenAudioStreamThread(&audio_open);
+    }
+}
+
+static AVCodecContext* WaitForAudioStream(void)
+{
+    AVCodecContext* context;
+
+    if (audio_open_thread) {
+        SDL_WaitThread(audio_open_thread, NULL);
+        audio_open_thread = NULL;
+    }
+    context = audio_open.context;
+    audio_open.context = NULL;
+    return context;
+}
+
+/* Queue decoded audio for playback, or NULL at the end of the stream */
+static void HandleAudioFrame(AVFrame* frame)
+{
+    if (frame) {
+        ++audio_frames_decoded;
+    }
+    if (!audio) {
+        return;
+    }
+
+    if (low_latency && frame &&
+        GetAudioRingQueued(audio_ring) > frame->sample_rate * LOW_LATENCY_AUDIO_MS / 1000) {
+        /* Live audio can't be allowed to back up behind the device */
+        ++audio_frames_dropped;
+        return;
+    }
+
+    TRACE_SCOPE("audio queue", frame ? GetFrameTraceID(frame) : 0);
+    if (!audio_tempo || !SendAudioTempoFrame(audio_tempo, frame)) {
+        /* Playing at normal speed, or the tempo filter isn't working */
+        if (frame) {
+            WriteAudioRing(audio_ring, frame);
+        }
+        return;
+    }
+
+    AVFrame* stretched;
+    while ((stretched = ReceiveAudioTempoFrame(audio_tempo)) != NULL) {
+        WriteAudioRing(audio_ring, stretched);
+    }
+}
+
+/* Stretch the audio from here on to match the playback speed */
+static void UpdateAudioTempo(void)
+{
+    if (audio_tempo) {
+        /* Play out what the old filter is holding first */
+        HandleAudioFrame(NULL);
+        DestroyAudioTempo(audio_tempo);
+        audio_tempo = NULL;
+    }
+    if (audio && playback_speed != 1.0) {
+        audio_tempo = CreateAudioTempo(playback_speed);
+        if (!audio_tempo) {
+            SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                        "Couldn't create audio tempo filter, audio won't change speed");
+        }
+    }
+}
+
+static void SetPlaybackSpeed(double speed)
+{
+    speed = SDL_clamp(speed, MIN_AUDIO_TEMPO, MAX_AUDIO_TEMPO);
+    if (speed == playback_speed) {
+        return;
+    }
+
+    if (clock_ticks) {
+        /* Continue the clock from where it is now, at the new rate */
+        clock_pts = GetPlaybackTime();
+        clock_ticks = SDL_GetTicks();
+    }
+    playback_speed = speed;
+
+    /* Audio that's already in the ring still plays at the old speed */
+    UpdateAudioTempo();
+    SDL_Log("Playback speed %.2fx\n", speed);
+}
+
+static void StepPlaybackSpeed(int direction)
+{
+    double speed = playback_speed;
+
+    for (int i = 0; i < (int)SDL_arraysize(playback_speeds); ++i) {
+        if (direction > 0 && playback_speeds[i] > playback_speed) {
+            speed = playback_speeds[i];
+            break;
+        }
+        if (direction < 0 && playback_speeds[i] < playback_speed) {
+            speed = playback_speeds[i];
+        }
+    }
+    SetPlaybackSpeed(speed);
+}
+
+static void av_log_callback(void* avcl, int level, const char* fmt, va_list vl)
+{
+    const char* pszCategory = NULL;
+
+    switch (level) {
+        case AV_LOG_PANIC:
+        case AV_LOG_FATAL:
+            pszCategory = "fatal error";
+            break;
+        case AV_LOG_ERROR:
+            pszCategory = "error";
+            break;
+        case AV_LOG_WARNING:
+            pszCategory = "warning";
+            break;
+        case AV_LOG_INFO:
+            pszCategory = "info";
+            break;
+        case AV_LOG_VERBOSE:
+            pszCategory = "verbose";
+            break;
+        case AV_LOG_DEBUG:
+            if (verbose) {
+                pszCategory = "debug";
+            }
+            break;
+    }
+
+    if (!pszCategory) {
+        // We don't care about this message
+        return;
+    }
+
+    /* This is called on decoder threads, so don't allocate or block here */
+    char prefix[32];
+    SDL_snprintf(prefix, sizeof(prefix), "ffmpeg %s: ", pszCategory);
+    AsyncLogV(prefix, fmt, vl);
+}
+
+static SDL_bool HasStreamParameters(AVFormatContext* ic, int stream)
+{
+    AVCodecParameters* codecpar;
+
+    if (stream < 0) {
+        return SDL_TRUE;
+    }
+    codecpar = ic->streams[stream]->codecpar;
+    if (codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
+        return (codecpar->width > 0 && codecpar->height > 0 && codecpar->format >= 0);
+    } else {
+        return (codecpar->sample_rate > 0 && codecpar->ch_layout.nb_channels > 0 &&
+                codecpar->format >= 0);
+    }
+}
+
+/* Limit the fast start probe to the streams we'll actually play, returns whether the container
+ * headers already describe them well enough to skip avformat_find_stream_info() altogether.
+ */
+static SDL_bool SelectFastStartStreams(AVFormatContext* ic)
+{
+    int video_stream = av_find_best_stream(ic, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+    int audio_stream = av_find_best_stream(ic, AVMEDIA_TYPE_AUDIO, -1, video_stream, NULL, 0);
+
+    for (unsigned int i = 0; i < ic->nb_streams; ++i) {
+        if ((int)i != video_stream && (int)i != audio_stream) {
+            ic->streams[i]->discard = AVDISCARD_ALL;
+        }
+    }
+    return (HasStreamParameters(ic, video_stream) && HasStreamParameters(ic, audio_stream));
+}
+
+static int SDLCALL ProbeMediaFile(void* data)
+{
+    ProbeData* probe_data = (ProbeData*)data;
+    AVDictionary* options = NULL;
+    Sint64 probesize = probe_data->probesize;
+    Sint64 analyzeduration = probe_data->analyzeduration;
+    Uint64 opened;
+
+    if (probe_data->low_latency) {
+        if (!probesize) {
+            probesize = LOW_LATENCY_PROBESIZE;
+        }
+        if (!analyzeduration) {
+            analyzeduration = LOW_LATENCY_ANALYZEDURATION;
+        }
+    }
+    if (probe_data->fast_start) {
+        if (!probesize) {
+            probesize = FAST_START_PROBESIZE;
+        }
+        if (!analyzeduration) {
+            analyzeduration = FAST_START_ANALYZEDURATION;
+        }
+    }
+    if (probesize) {
+        av_dict_set_int(&options, "probesize", probesize, 0);
+    }
+    if (analyzeduration) {
+        av_dict_set_int(&options, "analyzeduration", analyzeduration, 0);
+    }
+    if (probe_data->fast_start) {
+        /* Don't decode frames just to guess the frame rate */
+        av_dict_set_int(&options, "fpsprobesize", 0, 0);
+    }
+
+    BeginStartupStep(STARTUP_PROBE);
+    probe_data->result = avformat_open_input(&probe_data->ic, probe_data->file, NULL, &options);
+    av_dict_free(&options);
+    opened = SDL_GetPerformanceCounter();
+    if (probe_data->result >= 0 && probe_data->low_latency) {
+        /* Hand packets over as soon as they're read, even while finding the stream info */
+        probe_data->ic->flags |= AVFMT_FLAG_NOBUFFER;
+    }
+    if (probe_data->result >= 0) {
+        if (probe_data->fast_start && SelectFastStartStreams(probe_data->ic)) {
+            SDL_Log("Fast start, using stream parameters from the container\n");
+        } else {
+            int result = avformat_find_stream_info(probe_data->ic, NULL);
+            if (result < 0) {
+                /* We can still try to decode with what the demuxer knows */
+                SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Couldn't find stream info for %s: %s",
+                            probe_data->file, av_err2str(result));
+            }
+        }
+    }
+    EndStartupStep(STARTUP_PROBE);
+
+    SDL_Log("Probing took %.2f ms: open %.2f ms, stream info %.2f ms\n",
+            GetStartupMS(startup_step_end[STARTUP_PROBE]) -
+                GetStartupMS(startup_step_start[STARTUP_PROBE]),
+            GetStartupMS(opened) - GetStartupMS(startup_step_start[STARTUP_PROBE]),
+            GetStartupMS(startup_step_end[STARTUP_PROBE]) - GetStartupMS(opened));
+    return 0;
+}
+
+static void StartProbe(const char* file)
+{
+    probe.file = file;
+    probe.ic = NULL;
+    probe.result = 0;
+    probe_thread = SDL_CreateThread(ProbeMediaFile, "probe", &probe);
+    if (!probe_thread) {
+        ProbeMediaFile(&probe);
+    }
+}
+
+static AVFormatContext* WaitForProbe(int* result)
+{
+    AVFormatContext* ic;
+
+    JoinProbeThread();
+    ic = probe.ic;
+    probe.ic = NULL;
+    *result = probe.result;
+    return ic;
+}
+
+/* How often --mem-report logs while playing */
+#define MEMORY_REPORT_INTERVAL_MS 5000
+
+/* Count a texture and the conversion context uploading to it */
+static void AddTextureMemory(SDL_Texture* texture, MemoryReport* report)
+{
+    if (!texture) {
+        return;
+    }
+
+    AddMemory(report, MEMORY_TEXTURES, GetTextureMemory(texture));
+
+    struct SwsContextContainer* sws_container = (struct SwsContextContainer*)SDL_GetProperty(
+        SDL_GetTextureProperties(texture), SWS_CONTEXT_CONTAINER_PROPERTY, NULL);
+    if (sws_container) {
+        AddMemory(report, MEMORY_SWS, GetSwsContextMemory(sws_container->context));
+    }
+}
+
+static void AddVideoTileMemory(VideoTile* tile, MemoryReport* report)
+{
+    /* Only what the render thread shares, the decode task may be using the rest */
+    SDL_LockMutex(tile->lock);
+    for (int i = 0; i < tile->queue_count; ++i) {
+        AVFrame* queued = tile->queue[(tile->queue_head + i) % VIDEO_TILE_QUEUE_SIZE];
+        AddMemory(report, MEMORY_FRAMES, GetFrameMemory(queued));
+    }
+    SDL_UnlockMutex(tile->lock);
+
+    AddMemory(report, MEMORY_FRAMES, GetFrameMemory(tile->current));
+    AddTextureMemory(tile->texture, report);
+}
+
+static void LogPlayerMemory(AVPacket* pkt, AVFrame* frame, AVFrame* filtered)
+{
+    MemoryReport report;
+
+    SDL_zero(report);
+    AddMemory(&report, MEMORY_PACKETS, GetPacketMemory(pkt));
+    AddMemory(&report, MEMORY_FRAMES, GetFrameMemory(frame));
+    AddMemory(&report, MEMORY_FRAMES, GetFrameMemory(filtered));
+    AddVideoFilterMemory(video_filter, &report);
+    AddFrameCacheMemory(frame_cache, &report);
+    AddFrameCaptureMemory(frame_capture, &report);
+    AddVideoRecorderMemory(video_recorder, &report);
+    for (int i = 0; i < num_video_tiles; ++i) {
+        AddVideoTileMemory(&video_tiles[i], &report);
+    }
+    AddHugePageFrameMemory(&report);
+
+    AddTextureMemory(video_texture, &report);
+    AddTextureMemory(sprite, &report);
+
+    AddAudioRingMemory(audio_ring, &report);
+    if (audio) {
+        report.audio_stream_queued = (Uint64)SDL_max(SDL_GetAudioStreamQueued(audio), 0);
+    }
+
+    LogMemoryReport(&report);
+}
+
+/* Read the next packet and give it a trace ID */
+static int ReadPacket(AVFormatContext* ic, AVPacket* pkt)
+{
+    TraceScope scope("demux");
+
+    int result = av_read_frame(ic, pkt);
+    if (result >= 0) {
+        scope.SetFrame(SetPacketTraceID(pkt));
+    }
+    return result;
+}
+
+/* Write the --benchmark results as JSON, for the CTest benchmark suite to compare */
+static SDL_bool WriteBenchmarkResults(const char* path,
+                                      const char* file,
+                                      AVCodecContext* video_context,
+                                      AVCodecContext* audio_context,
+                                      Uint64 start)
+{
+    double seconds = (double)(SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+    int frames = video_stage_frames[VIDEO_STAGE_RENDER];
+    double stage_ms[VIDEO_STAGE_COUNT];
+    const char* name = file;
+
+    for (const char* p = file; *p; ++p) {
+        if (*p == '/' || *p == '\\') {
+            name = p + 1;
+        }
+    }
+    GetVideoStageTimes(stage_ms);
+
+    SDL_IOStream* io = SDL_IOFromFile(path, "w");
+    if (!io) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Couldn't create %s: %s", path, SDL_GetError());
+        return SDL_FALSE;
+    }
+    SDL_IOprintf(io, "{\n");
+    SDL_IOprintf(io, "  \"file\": \"%s\",\n", name);
+    if (video_context) {
+        const char* pix_fmt = av_get_pix_fmt_name(video_context->pix_fmt);
+        SDL_IOprintf(io, "  \"video_codec\": \"%s\",\n", avcodec_get_name(video_context->codec_id));
+        SDL_IOprintf(io, "  \"pix_fmt\": \"%s\",\n", pix_fmt ? pix_fmt : "none");
+        SDL_IOprintf(io, "  \"width\": %d,\n", video_context->width);
+        SDL_IOprintf(io, "  \"height\": %d,\n", video_context->height);
+    }
+    if (audio_context) {
+        SDL_IOprintf(io, "  \"audio_codec\": \"%s\",\n", avcodec_get_name(audio_context->codec_id));
+        SDL_IOprintf(io, "  \"channels\": %d,\n", audio_context->ch_layout.nb_channels);
+    }
+    SDL_IOprintf(io, "  \"frames\": %d,\n", frames);
+    SDL_IOprintf(io, "  \"audio_frames\": %d,\n", audio_frames_decoded);
+    SDL_IOprintf(io, "  \"seconds\": %.3f,\n", seconds);
+    SDL_IOprintf(io, "  \"fps\": %.2f,\n", seconds > 0.0 ? frames / seconds : 0.0);
+    for (int i = 0; i < VIDEO_STAGE_COUNT; ++i) {
+        double ms = video_stage_frames[i] > 0 ? stage_ms[i] / video_stage_frames[i] : 0.0;
+        SDL_IOprintf(io, "  \"%s_ms\": %.3f,\n", video_stage_names[i], ms);
+    }
+    SDL_IOprintf(io, "  \"skipped_frames\": %d\n", video_frames_skipped);
+    SDL_IOprintf(io, "}\n");
+    if (SDL_CloseIO(io) < 0) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Couldn't write %s: %s", path, SDL_GetError());
+        return SDL_FALSE;
+    }
+    SDL_Log("Benchmark: %d frames in %.2f seconds, %.2f FPS\n", frames, seconds,
+            seconds > 0.0 ? frames / seconds : 0.0);
+    return SDL_TRUE;
+}
+
+/* Show a decoded or filtered frame when it's due */
+static void ShowVideoFrame(AVCodecContext* context, AVFrame* frame, double* first_pts)
+{
+    double pts = ((double)frame->pts * context->pkt_timebase.num) / context->pkt_timebase.den;
+    if (*first_pts < 0.0) {
+        *first_pts = pts;
+    }
+    pts -= *first_pts;
+
+    UpdateVideoFrameSkipping(context, pts);
+    shown_pts = frame->pts;
+    HandleVideoFrame(frame, pts);
+}
+
+/* Keep decoded frames for stepping back. By default that's only while paused, the first step
+ * back decodes the GOP into the cache in one pass. With --frame-cache software frames are kept
+ * while playing too, hardware frames never are, copying every one would cost more than decoding
+ * the few that get stepped to again.
+ */
+static void CacheVideoFrame(AVCodecContext* context, AVFrame* frame)
+{
+    if (frame_cache && (paused || (frame_cache_playback && !frame->hw_frames_ctx))) {
+        /* Catching up skips frames, so the one decoded before may not be the one before it */
+        Sint64 prev_pts = (context->skip_frame == AVDISCARD_DEFAULT) ? decoded_pts : AV_NOPTS_VALUE;
+        AddCachedFrame(frame_cache, frame, prev_pts);
+    }
+    decoded_pts = frame->pts;
+}
 
-    result = avcodec_open2(context, codec, NULL);
-    if (result < 0) {
-        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Couldn't open codec %s: %s",
-                     avcodec_get_name(context->codec_id), av_err2str(result));
-        avcodec_free_context(&context);
-        return NULL;
+/* Frames decoded after seeking back to resume playback aren't played until they catch up */
+static SDL_bool SkipToResumePoint(const AVFrame* frame, AVRational time_base, Sint64* resume_pts)
+{
+    if (*resume_pts == AV_NOPTS_VALUE) {
+        return SDL_FALSE;
     }
-
-    SDL_AudioSpec spec = {SDL_AUDIO_F32, codecpar->ch_layout.nb_channels, codecpar->sample_rate};
-    audio = SDL_OpenAudioDeviceStream(SDL_AUDIO_DEVICE_DEFAULT_PLAYBACK, &spec, NULL, NULL);
-    if (audio) {
-        SDL_ResumeAudioDevice(SDL_GetAudioStreamDevice(audio));
-    } else {
-        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Couldn't open audio: %s", SDL_GetError());
+    if (frame->pts != AV_NOPTS_VALUE &&
+        av_compare_ts(frame->pts, time_base, *resume_pts, resume_time_base) < 0) {
+        return SDL_TRUE;
     }
-    return context;
+    *resume_pts = AV_NOPTS_VALUE;
+    return SDL_FALSE;
 }
 
-static SDL_AudioFormat GetAudioFormat(enum AVSampleFormat format)
+/* Seek to the keyframe at or before pts */
+static SDL_bool SeekVideo(AVFormatContext* ic, int stream, AVCodecContext* context, Sint64 pts)
 {
-    switch (format) {
-        case AV_SAMPLE_FMT_U8:
-        case AV_SAMPLE_FMT_U8P:
-            return SDL_AUDIO_U8;
-        case AV_SAMPLE_FMT_S16:
-        case AV_SAMPLE_FMT_S16P:
-            return SDL_AUDIO_S16;
-        case AV_SAMPLE_FMT_S32:
-        case AV_SAMPLE_FMT_S32P:
-            return SDL_AUDIO_S32;
-        case AV_SAMPLE_FMT_FLT:
-        case AV_SAMPLE_FMT_FLTP:
-            return SDL_AUDIO_F32;
-        default:
-            /* Unsupported */
-            return 0;
+    int result = av_seek_frame(ic, stream, pts, AVSEEK_FLAG_BACKWARD);
+    if (result < 0) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Couldn't seek: %s", av_err2str(result));
+        return SDL_FALSE;
     }
+    avcodec_flush_buffers(context);
+    decoded_pts = AV_NOPTS_VALUE;
+    return SDL_TRUE;
 }
 
-static SDL_bool IsPlanarAudioFormat(enum AVSampleFormat format)
+/* Decode the next video frame into the cache while paused, other packets are dropped */
+static SDL_bool DecodeNextVideoFrame(AVFormatContext* ic,
+                                     int stream,
+                                     AVCodecContext* context,
+                                     AVPacket* pkt,
+                                     AVFrame* frame)
 {
-    switch (format) {
-        case AV_SAMPLE_FMT_U8P:
-        case AV_SAMPLE_FMT_S16P:
-        case AV_SAMPLE_FMT_S32P:
-        case AV_SAMPLE_FMT_FLTP:
-        case AV_SAMPLE_FMT_DBLP:
-        case AV_SAMPLE_FMT_S64P:
+    for (;;) {
+        int result = avcodec_receive_frame(context, frame);
+        if (result >= 0) {
+            CacheVideoFrame(context, frame);
             return SDL_TRUE;
-        default:
+        }
+        if (result != AVERROR(EAGAIN)) {
+            /* The end of the stream, stepping back seeks and starts decoding again */
             return SDL_FALSE;
+        }
+
+        if (ReadPacket(ic, pkt) < 0) {
+            avcodec_send_packet(context, NULL);
+            continue;
+        }
+        if (pkt->stream_index == stream) {
+            TRACE_SCOPE("video send", GetPacketTraceID(pkt));
+            result = avcodec_send_packet(context, pkt);
+            if (result < 0) {
+                SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                             "avcodec_send_packet(video_context) failed: %s", av_err2str(result));
+            }
+        }
+        av_packet_unref(pkt);
     }
 }
 
-static void InterleaveAudio(AVFrame* frame, const SDL_AudioSpec* spec)
+static void ShowSteppedFrame(AVFrame* frame)
 {
-    int c, n;
-    int samplesize = SDL_AUDIO_BYTESIZE(spec->format);
-    int framesize = SDL_AUDIO_FRAMESIZE(*spec);
-    Uint8* data = (Uint8*)SDL_malloc(frame->nb_samples * framesize);
-    if (!data) {
-        return;
+    SDL_Texture** texture = GetCachedFrameTexture(frame_cache, frame);
+    SDL_bool uploaded = SDL_FALSE;
+
+    if (!texture) {
+        texture = &video_texture;
+    } else if (*texture) {
+        /* Stepped to before, the texture is still good */
+        uploaded = SDL_TRUE;
     }
 
-    /* This could be optimized with SIMD and not allocating memory each time */
-    for (c = 0; c < spec->channels; ++c) {
-        const Uint8* src = frame->data[c];
-        Uint8* dst = data + c * samplesize;
-        for (n = frame->nb_samples; n--;) {
-            SDL_memcpy(dst, src, samplesize);
-            src += samplesize;
-            dst += framesize;
-        }
+    if (BeginFrameRendering(frame) < 0) {
+        return;
+    }
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+    SDL_RenderClear(renderer);
+    if (uploaded || GetTextureForFrame(frame, texture)) {
+        RenderVideoTexture(frame, *texture);
+    } else {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Couldn't get texture for frame: %s\n",
+                     SDL_GetError());
     }
-    SDL_PutAudioStreamData(audio, data, frame->nb_samples * framesize);
-    SDL_free(data);
+    PresentRenderer(GetFrameTraceID(frame));
+    FinishFrameRendering(frame);
+
+    /* The new texture counts against the cache budget */
+    TrimFrameCache(frame_cache);
+    shown_pts = frame->pts;
+    stepped = SDL_TRUE;
 }
 
-static void HandleAudioFrame(AVFrame* frame)
+static void StepVideoForward(AVFormatContext* ic,
+                             int stream,
+                             AVCodecContext* context,
+                             AVPacket* pkt,
+                             AVFrame* frame)
 {
-    if (audio) {
-        SDL_AudioSpec spec = {GetAudioFormat(static_cast<AVSampleFormat>(frame->format)),
-                              frame->ch_layout.nb_channels, frame->sample_rate};
-        SDL_SetAudioStreamFormat(audio, &spec, NULL);
+    AVFrame* next = GetNextCachedFrame(frame_cache, shown_pts);
 
-        if (frame->ch_layout.nb_channels > 1 &&
-            IsPlanarAudioFormat(static_cast<AVSampleFormat>(frame->format))) {
-            InterleaveAudio(frame, &spec);
-        } else {
-            SDL_PutAudioStreamData(audio, frame->data[0],
-                                   frame->nb_samples * SDL_AUDIO_FRAMESIZE(spec));
+    if (!next && shown_pts != AV_NOPTS_VALUE && decoded_pts != shown_pts) {
+        /* A step back moved the decoder, catch it up with the frame on screen */
+        if (SeekVideo(ic, stream, context, shown_pts)) {
+            while (DecodeNextVideoFrame(ic, stream, context, pkt, frame) &&
+                   decoded_pts < shown_pts) {
+            }
+        }
+    }
+    if (!next && DecodeNextVideoFrame(ic, stream, context, pkt, frame)) {
+        next = GetCachedFrame(frame_cache, frame->pts);
+        if (!next) {
+            /* Over budget or out of memory, show it anyway */
+            next = frame;
         }
     }
+    if (next) {
+        ShowSteppedFrame(next);
+    }
 }
 
-static void av_log_callback(void* avcl, int level, const char* fmt, va_list vl)
+static void StepVideoBackward(AVFormatContext* ic,
+                              int stream,
+                              AVCodecContext* context,
+                              AVPacket* pkt,
+                              AVFrame* frame)
 {
-    const char* pszCategory = NULL;
-    char* message;
+    Sint64 target = shown_pts;
 
-    switch (level) {
-        case AV_LOG_PANIC:
-        case AV_LOG_FATAL:
-            pszCategory = "fatal error";
-            break;
-        case AV_LOG_ERROR:
-            pszCategory = "error";
-            break;
-        case AV_LOG_WARNING:
-            pszCategory = "warning";
-            break;
-        case AV_LOG_INFO:
-            pszCategory = "info";
-            break;
-        case AV_LOG_VERBOSE:
-            pszCategory = "verbose";
-            break;
-        case AV_LOG_DEBUG:
-            if (verbose) {
-                pszCategory = "debug";
+    if (target == AV_NOPTS_VALUE) {
+        return;
+    }
+
+    AVFrame* previous = GetPreviousCachedFrame(frame_cache, target);
+    if (!previous) {
+        /* Decode from the keyframe before into the cache in a single pass, so the following
+         * steps back don't seek and decode the start of the GOP all over again
+         */
+        if (SeekVideo(ic, stream, context, target - 1)) {
+            while (DecodeNextVideoFrame(ic, stream, context, pkt, frame) &&
+                   decoded_pts < target) {
             }
-            break;
+            previous = GetPreviousCachedFrame(frame_cache, target);
+        }
+    }
+    if (previous) {
+        ShowSteppedFrame(previous);
     }
+}
 
-    if (!pszCategory) {
-        // We don't care about this message
-        return;
+static void PausePlayback(AVCodecContext* video_context)
+{
+    paused = SDL_TRUE;
+    stepped = SDL_FALSE;
+    if (audio) {
+        SDL_PauseAudioDevice(SDL_GetAudioStreamDevice(audio));
+    }
+    if (video_context) {
+        /* Any frame can be stepped to */
+        video_context->skip_frame = AVDISCARD_DEFAULT;
+    }
+    SDL_Log("Paused\n");
+}
+
+/* Returns SDL_TRUE if playback seeked back to where the stepping left off */
+static SDL_bool ResumePlayback(AVFormatContext* ic,
+                               int video_stream,
+                               AVCodecContext* audio_context,
+                               AVCodecContext* video_context)
+{
+    SDL_bool seeked = SDL_FALSE;
+
+    if (stepped && SeekVideo(ic, video_stream, video_context, shown_pts)) {
+        resume_time_base = video_context->pkt_timebase;
+        video_resume_pts = shown_pts;
+        if (audio_context) {
+            avcodec_flush_buffers(audio_context);
+            audio_resume_pts = shown_pts;
+        }
+        if (audio) {
+            /* What was queued before the pause doesn't go with this frame anymore */
+            DestroyAudioTempo(audio_tempo);
+            audio_tempo = NULL;
+            ClearAudioRing(audio_ring);
+            SDL_ClearAudioStream(audio);
+            UpdateAudioTempo();
+        }
+        seeked = SDL_TRUE;
     }
+    paused = SDL_FALSE;
+    stepped = SDL_FALSE;
 
-    SDL_vasprintf(&message, fmt, vl);
-    SDL_Log("ffmpeg %s: %s", pszCategory, message);
-    SDL_free(message);
+    /* The clock starts again with the next frame shown */
+    clock_ticks = 0;
+    if (audio) {
+        SDL_ResumeAudioDevice(SDL_GetAudioStreamDevice(audio));
+    }
+    SDL_Log("Playing\n");
+    return seeked;
 }
 
 static void print_usage(SDLTest_CommonState* state, const char* argv0)
 {
     static const char* options[] = {"[--verbose]",
                                     "[--sprites N]",
+                                    "[--sprite-collisions]",
+                                    "[--sprite-benchmark]",
                                     "[--audio-codec codec]",
+                                    "[--audio-latency MS]",
+                                    "[--speed X]",
+                                    "[--vf filtergraph]",
+                                    "[--frame-cache MB]",
                                     "[--video-codec codec]",
                                     "[--software]",
-                                    "video_file",
+                                    "[--clear-hw-cache]",
+                                    "[--hugepages]",
+                                    "[--render-cpus LIST]",
+                                    "[--audio-cpus LIST]",
+                                    "[--decode-cpus LIST]",
+                                    "[--threads N]",
+                                    "[--trace FILE]",
+                                    "[--mem-report]",
+                                    "[--benchmark FILE.json]",
+                                    "[--low-latency]",
+                                    "[--capture-every N]",
+                                    "[--capture-raw]",
+                                    "[--record FILE]",
+                                    "[--record-threads N]",
+                                    "[--probesize BYTES]",
+                                    "[--analyzeduration USEC]",
+                                    "[--fast-start]",
+                                    "video_file [video_file...]",
                                     NULL};
     SDLTest_CommonLogUsage(state, argv0, options);
 }
@@ -1399,6 +3106,12 @@ static void print_usage(SDLTest_CommonState* state, const char* argv0)
 int main(int argc, char* argv[])
 {
     const char* file = NULL;
+    const char** files = NULL;
+    int num_files = 0;
+    int num_threads = 0;
+    const char* record_file = NULL;
+    int record_threads = 0;
+    SDL_bool sprite_benchmark = SDL_FALSE;
     AVFormatContext* ic = NULL;
     int audio_stream = -1;
     int video_stream = -1;
@@ -1410,6 +3123,8 @@ int main(int argc, char* argv[])
     AVCodecContext* video_context = NULL;
     AVPacket* pkt = NULL;
     AVFrame* frame = NULL;
+    AVFrame* filtered = NULL;
+    AVFrame* newest = NULL;
     double first_pts = -1.0;
     int i;
     int result;
@@ -1417,8 +3132,14 @@ int main(int argc, char* argv[])
     SDL_WindowFlags window_flags;
     SDL_bool flushing = SDL_FALSE;
     SDL_bool decoded = SDL_FALSE;
+    SDL_bool seen_keyframe = SDL_FALSE;
+    Uint64 next_memory_report = 0;
+    Uint64 benchmark_start = 0;
+    Sint32 timeout = 0;
     SDLTest_CommonState* state;
 
+    startup_time = SDL_GetPerformanceCounter();
+
     /* Initialize test framework */
     state = SDLTest_CommonCreateState(argv, 0);
 
@@ -1426,8 +3147,18 @@ int main(int argc, char* argv[])
     SDL_SetLogPriority(SDL_LOG_CATEGORY_APPLICATION, SDL_LOG_PRIORITY_INFO);
 
     /* Log ffmpeg messages */
+    if (!StartAsyncLog()) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "Couldn't start log thread, logging synchronously");
+    }
     av_log_set_callback(av_log_callback);
 
+    files = (const char**)SDL_calloc(argc, sizeof(*files));
+    if (!files) {
+        return_code = 1;
+        goto quit;
+    }
+
     /* Parse commandline */
     for (i = 1; i < argc;) {
         int consumed;
@@ -1440,6 +3171,26 @@ int main(int argc, char* argv[])
             } else if (SDL_strcmp(argv[i], "--sprites") == 0 && argv[i + 1]) {
                 num_sprites = SDL_atoi(argv[i + 1]);
                 consumed = 2;
+            } else if (SDL_strcmp(argv[i], "--sprite-collisions") == 0) {
+                sprite_collisions = SDL_TRUE;
+                consumed = 1;
+            } else if (SDL_strcmp(argv[i], "--sprite-benchmark") == 0) {
+                sprite_benchmark = SDL_TRUE;
+                consumed = 1;
+            } else if (SDL_strcmp(argv[i], "--audio-latency") == 0 && argv[i + 1]) {
+                audio_latency_ms = SDL_max(SDL_atoi(argv[i + 1]), 1);
+                consumed = 2;
+            } else if (SDL_strcmp(argv[i], "--speed") == 0 && argv[i + 1]) {
+                playback_speed =
+                    SDL_clamp(SDL_atof(argv[i + 1]), MIN_AUDIO_TEMPO, MAX_AUDIO_TEMPO);
+                consumed = 2;
+            } else if (SDL_strcmp(argv[i], "--vf") == 0 && argv[i + 1]) {
+                video_filter_description = argv[i + 1];
+                consumed = 2;
+            } else if (SDL_strcmp(argv[i], "--frame-cache") == 0 && argv[i + 1]) {
+                frame_cache_mb = SDL_max(SDL_atoi(argv[i + 1]), 0);
+                frame_cache_playback = SDL_TRUE;
+                consumed = 2;
             } else if (SDL_strcmp(argv[i], "--audio-codec") == 0 && argv[i + 1]) {
                 audio_codec_name = argv[i + 1];
                 consumed = 2;
@@ -1449,9 +3200,69 @@ int main(int argc, char* argv[])
             } else if (SDL_strcmp(argv[i], "--software") == 0) {
                 software_only = SDL_TRUE;
                 consumed = 1;
-            } else if (!file) {
-                /* We'll try to open this as a media file */
-                file = argv[i];
+            } else if (SDL_strcmp(argv[i], "--probesize") == 0 && argv[i + 1]) {
+                probe.probesize = SDL_strtoll(argv[i + 1], NULL, 10);
+                consumed = 2;
+            } else if (SDL_strcmp(argv[i], "--analyzeduration") == 0 && argv[i + 1]) {
+                probe.analyzeduration = SDL_strtoll(argv[i + 1], NULL, 10);
+                consumed = 2;
+            } else if (SDL_strcmp(argv[i], "--fast-start") == 0) {
+                probe.fast_start = SDL_TRUE;
+                consumed = 1;
+            } else if (SDL_strcmp(argv[i], "--clear-hw-cache") == 0) {
+                ClearHWConfigCache();
+                consumed = 1;
+            } else if (SDL_strcmp(argv[i], "--hugepages") == 0) {
+                use_hugepages = SDL_TRUE;
+                consumed = 1;
+            } else if ((SDL_strcmp(argv[i], "--render-cpus") == 0 ||
+                        SDL_strcmp(argv[i], "--audio-cpus") == 0 ||
+                        SDL_strcmp(argv[i], "--decode-cpus") == 0) &&
+                       argv[i + 1]) {
+                CPUMask cpus;
+                if (ParseCPUList(argv[i + 1], &cpus)) {
+                    if (SDL_strcmp(argv[i], "--render-cpus") == 0) {
+                        SetThreadRoleCPUs(CPU_THREAD_RENDER, &cpus);
+                    } else if (SDL_strcmp(argv[i], "--audio-cpus") == 0) {
+                        SetThreadRoleCPUs(CPU_THREAD_AUDIO, &cpus);
+                    } else {
+                        SetThreadRoleCPUs(CPU_THREAD_DECODE, &cpus);
+                    }
+                    consumed = 2;
+                }
+            } else if (SDL_strcmp(argv[i], "--trace") == 0 && argv[i + 1]) {
+                if (!StartTrace(argv[i + 1])) {
+                    SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Couldn't start trace: %s",
+                                SDL_GetError());
+                }
+                consumed = 2;
+            } else if (SDL_strcmp(argv[i], "--mem-report") == 0) {
+                memory_report = SDL_TRUE;
+                consumed = 1;
+            } else if (SDL_strcmp(argv[i], "--benchmark") == 0 && argv[i + 1]) {
+                benchmark_file = argv[i + 1];
+                consumed = 2;
+            } else if (SDL_strcmp(argv[i], "--low-latency") == 0) {
+                low_latency = SDL_TRUE;
+                consumed = 1;
+            } else if (SDL_strcmp(argv[i], "--capture-every") == 0 && argv[i + 1]) {
+                capture_every = SDL_max(SDL_atoi(argv[i + 1]), 0);
+                consumed = 2;
+            } else if (SDL_strcmp(argv[i], "--capture-raw") == 0) {
+                capture_format = FRAME_CAPTURE_RAW;
+                consumed = 1;
+            } else if (SDL_strcmp(argv[i], "--record") == 0 && argv[i + 1]) {
+                record_file = argv[i + 1];
+                consumed = 2;
+            } else if (SDL_strcmp(argv[i], "--record-threads") == 0 && argv[i + 1]) {
+                record_threads = SDL_max(SDL_atoi(argv[i + 1]), 0);
+                consumed = 2;
+            } else if (SDL_strcmp(argv[i], "--threads") == 0 && argv[i + 1]) {
+                num_threads = SDL_atoi(argv[i + 1]);
+                consumed = 2;
+            } else if (argv[i][0] != '-') {
+                /* We'll try to open this as a media file, more than one makes a video wall */
+                files[num_files++] = argv[i];
                 consumed = 1;
             }
         }
@@ -1464,16 +3275,104 @@ int main(int argc, char* argv[])
         i += consumed;
     }
 
-    if (!file) {
+    if (num_files == 0 && !sprite_benchmark) {
         print_usage(state, argv[0]);
         return_code = 1;
         goto quit;
     }
+    file = files[0];
+
+    if (sprite_benchmark && num_sprites <= 0) {
+        num_sprites = 1000000;
+    }
+
+    if (benchmark_file) {
+        if (num_files != 1) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "--benchmark takes a single media file");
+            return_code = 1;
+            goto quit;
+        }
+        /* Headless and on the CPU, so results from different runs and machines compare */
+        SDL_SetHint(SDL_HINT_VIDEO_DRIVER, "offscreen");
+        SDL_SetHint(SDL_HINT_RENDER_DRIVER, "software");
+        software_only = SDL_TRUE;
+        playback_speed = 1.0;
+    }
+
+    if (low_latency) {
+        if (num_files != 1) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "--low-latency takes a single source");
+            return_code = 1;
+            goto quit;
+        }
+        if (playback_speed != 1.0) {
+            SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "--speed isn't supported for live sources");
+            playback_speed = 1.0;
+        }
+        /* Start on the first keyframe, with as little probing as possible */
+        probe.fast_start = SDL_TRUE;
+        probe.low_latency = SDL_TRUE;
+    }
+
+    if (num_files > 1) {
+        /* Tiles are decoded on the worker pool, where hardware frames can't be used */
+        software_only = SDL_TRUE;
+
+        if (playback_speed != 1.0) {
+            SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "--speed isn't supported for a video wall");
+            playback_speed = 1.0;
+        }
+        if (video_filter_description) {
+            SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "--vf isn't supported for a video wall");
+            video_filter_description = NULL;
+        }
+    }
+
+    SetTraceThreadName("main");
+
+    if (num_files > 1 || num_sprites >= SPRITE_LAYER_PARALLEL_COUNT) {
+        worker_pool = CreateWorkerPool(num_threads > 0 ? num_threads : SDL_GetCPUCount());
+        if (!worker_pool) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Couldn't create worker pool: %s",
+                         SDL_GetError());
+            return_code = 2;
+            goto quit;
+        }
+    }
+
+    if (use_hugepages && !CreateHugePageFrameAllocator()) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Couldn't create huge page allocator: %s",
+                     SDL_GetError());
+        return_code = 2;
+        goto quit;
+    }
+
+    if (sprite_benchmark) {
+        /* Measure the sprite update on its own, without any video */
+        srand((unsigned int)time(NULL));
+        return_code =
+            (RunSpriteBenchmark(num_sprites, sprite_collisions, worker_pool) == 0) ? 0 : 3;
+        goto quit;
+    }
+
+    if (num_files == 1) {
+        /* Open the media file while SDL and the window come up */
+        StartProbe(file);
+
+        /* This is optional, without it every hardware configuration is tried */
+        hw_config_cache = LoadHWConfigCache();
+    }
 
+    BeginStartupStep(STARTUP_SDL_INIT);
     if (SDL_Init(SDL_INIT_AUDIO | SDL_INIT_VIDEO) < 0) {
         return_code = 2;
         goto quit;
     }
+    EndStartupStep(STARTUP_SDL_INIT);
+
+    wake_event_type = SDL_RegisterEvents(1);
+
+    BeginStartupStep(STARTUP_WINDOW);
 
     window_flags = SDL_WINDOW_HIDDEN | SDL_WINDOW_RESIZABLE | SDL_WINDOW_HIGH_PIXEL_DENSITY;
 #ifdef SDL_PLATFORM_APPLE
@@ -1481,56 +3380,67 @@ int main(int argc, char* argv[])
 #elif !defined(SDL_PLATFORM_WIN32)
     window_flags |= SDL_WINDOW_OPENGL;
 #endif
+    if (benchmark_file) {
+        /* The offscreen driver doesn't need a GL or Metal surface for the software renderer */
+        window_flags &= ~(SDL_WINDOW_OPENGL | SDL_WINDOW_METAL);
+    }
     if (SDL_GetHint(SDL_HINT_RENDER_DRIVER) != NULL) {
-        CreateWindowAndRenderer(window_flags, SDL_GetHint(SDL_HINT_RENDER_DRIVER));
+        /* Vulkan video is only set up for a single stream, and only if the decoder can use it */
+        use_vulkan_video = (num_files == 1);
+        CreateWindowAndRenderer(window_flags, SDL_GetHint(SDL_HINT_RENDER_DRIVER),
+                                video_codec_name);
     }
 #ifdef HAVE_EGL
     /* Try to create an EGL compatible window for DRM hardware frame support */
     if (!window) {
-        CreateWindowAndRenderer(window_flags, "opengles2");
+        CreateWindowAndRenderer(window_flags, "opengles2", video_codec_name);
     }
 #endif
 #ifdef SDL_PLATFORM_APPLE
     if (!window) {
-        CreateWindowAndRenderer(window_flags, "metal");
+        CreateWindowAndRenderer(window_flags, "metal", video_codec_name);
     }
 #endif
 #ifdef SDL_PLATFORM_WIN32
     if (!window) {
-        CreateWindowAndRenderer(window_flags, "direct3d11");
+        CreateWindowAndRenderer(window_flags, "direct3d11", video_codec_name);
     }
 #endif
     if (!window) {
-        if (!CreateWindowAndRenderer(window_flags, NULL)) {
+        if (!CreateWindowAndRenderer(window_flags, NULL, video_codec_name)) {
             return_code = 2;
             goto quit;
         }
     }
+    EndStartupStep(STARTUP_WINDOW);
 
     if (SDL_SetWindowTitle(window, file) < 0) {
         SDL_Log("SDL_SetWindowTitle: %s", SDL_GetError());
     }
 
-    /* Open the media file */
-    result = avformat_open_input(&ic, file, NULL, NULL);
+    if (num_files > 1) {
+        BeginStartupStep(STARTUP_VIDEO_DECODER);
+        if (!OpenVideoWall(files, num_files, video_codec_name)) {
+            return_code = 4;
+            goto quit;
+        }
+        EndStartupStep(STARTUP_VIDEO_DECODER);
+        goto create_sprites;
+    }
+
+    /* Wait for the media file to be opened */
+    ic = WaitForProbe(&result);
     if (result < 0) {
-        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Couldn't open %s: %d", argv[1], result);
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Couldn't open %s: %d", file, result);
         return_code = 4;
         goto quit;
     }
     video_stream = av_find_best_stream(ic, AVMEDIA_TYPE_VIDEO, -1, -1, &video_codec, 0);
-    if (video_stream >= 0) {
-        if (video_codec_name) {
-            video_codec = avcodec_find_decoder_by_name(video_codec_name);
-            if (!video_codec) {
-                SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Couldn't find codec '%s'",
-                             video_codec_name);
-                return_code = 4;
-                goto quit;
-            }
-        }
-        video_context = OpenVideoStream(ic, video_stream, video_codec);
-        if (!video_context) {
+    if (video_stream >= 0 && video_codec_name) {
+        video_codec = avcodec_find_decoder_by_name(video_codec_name);
+        if (!video_codec) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Couldn't find codec '%s'",
+                         video_codec_name);
             return_code = 4;
             goto quit;
         }
@@ -1546,11 +3456,38 @@ int main(int argc, char* argv[])
                 goto quit;
             }
         }
-        audio_context = OpenAudioStream(ic, audio_stream, audio_codec);
+
+        /* Open the audio device while the video decoder initializes */
+        StartOpenAudioStream(ic, audio_stream, audio_codec);
+    }
+    if (video_stream >= 0) {
+        BeginStartupStep(STARTUP_VIDEO_DECODER);
+        video_context = OpenVideoStream(ic, video_stream, video_codec, NULL);
+        if (!video_context) {
+            return_code = 4;
+            goto quit;
+        }
+        if (video_filter_description) {
+            video_filter = CreateVideoFilter(video_filter_description, video_context->pkt_timebase);
+            if (!video_filter) {
+                SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Couldn't create video filter: %s",
+                             SDL_GetError());
+                return_code = 4;
+                goto quit;
+            }
+        }
+        if (frame_cache_mb > 0 && !video_filter) {
+            frame_cache = CreateFrameCache((Uint64)frame_cache_mb * 1024 * 1024);
+        }
+        EndStartupStep(STARTUP_VIDEO_DECODER);
+    }
+    if (audio_stream >= 0) {
+        audio_context = WaitForAudioStream();
         if (!audio_context) {
             return_code = 4;
             goto quit;
         }
+        UpdateAudioTempo();
     }
     pkt = av_packet_alloc();
     if (!pkt) {
@@ -1559,12 +3496,15 @@ int main(int argc, char* argv[])
         goto quit;
     }
     frame = av_frame_alloc();
-    if (!frame) {
+    filtered = av_frame_alloc();
+    newest = av_frame_alloc();
+    if (!frame || !filtered || !newest) {
         SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "av_frame_alloc failed");
         return_code = 4;
         goto quit;
     }
 
+create_sprites:
     /* Create the sprite */
     sprite = CreateTexture(renderer, icon_bmp, icon_bmp_len, &sprite_w, &sprite_h);
 
@@ -1574,51 +3514,131 @@ int main(int argc, char* argv[])
         goto quit;
     }
 
-    /* Allocate memory for the sprite info */
-    positions = (SDL_FRect*)SDL_malloc(num_sprites * sizeof(*positions));
-    velocities = (SDL_FRect*)SDL_malloc(num_sprites * sizeof(*velocities));
-    if (!positions || !velocities) {
+    /* Position sprites and set their velocities */
+    SDL_Rect viewport;
+    SDL_GetRenderViewport(renderer, &viewport);
+    srand((unsigned int)time(NULL));
+    sprites = CreateSpriteLayer(num_sprites, sprite_w, sprite_h, viewport.w, viewport.h);
+    if (!sprites || !SetSpriteLayerCollisions(sprites, sprite_collisions)) {
         SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Out of memory!\n");
         return_code = 3;
         goto quit;
     }
 
-    /* Position sprites and set their velocities */
-    SDL_Rect viewport;
-    SDL_GetRenderViewport(renderer, &viewport);
-    srand((unsigned int)time(NULL));
-    for (i = 0; i < num_sprites; ++i) {
-        positions[i].x = (float)(rand() % (viewport.w - sprite_w));
-        positions[i].y = (float)(rand() % (viewport.h - sprite_h));
-        positions[i].w = (float)sprite_w;
-        positions[i].h = (float)sprite_h;
-        velocities[i].x = 0.0f;
-        velocities[i].y = 0.0f;
-        while (velocities[i].x == 0.f || velocities[i].y == 0.f) {
-            velocities[i].x = (float)((rand() % (2 + 1)) - 1);
-            velocities[i].y = (float)((rand() % (2 + 1)) - 1);
+    if (capture_every > 0) {
+        frame_capture = CreateFrameCapture(CAPTURE_PREFIX, capture_format);
+        if (!frame_capture) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Couldn't start frame capture: %s",
+                         SDL_GetError());
+            return_code = 3;
+            goto quit;
+        }
+    }
+
+    if (record_file) {
+        video_recorder = CreateVideoRecorder(record_file, record_threads);
+        if (!video_recorder) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Couldn't record to %s: %s", record_file,
+                         SDL_GetError());
+            return_code = 3;
+            goto quit;
         }
     }
 
+    /* The main thread renders. It's pinned once the threads it starts have been created, since
+     * they would inherit its mask, and threads with a role of their own pin themselves.
+     */
+    PinCurrentThread(CPU_THREAD_RENDER);
+
     /* We're ready to go! */
     SDL_ShowWindow(window);
 
     /* Main render loop */
     done = 0;
+    BeginStartupStep(STARTUP_FIRST_FRAME);
+    benchmark_start = SDL_GetPerformanceCounter();
 
     while (!done) {
-        SDL_Event event;
+        if (memory_report) {
+            Uint64 now = SDL_GetTicks();
+            Sint32 report_ms = (next_memory_report > now) ? (Sint32)(next_memory_report - now) : 0;
+            timeout = GetShorterTimeout(timeout, report_ms);
+        }
+        WaitForMainLoop(timeout);
+        timeout = 0;
+        if (done) {
+            break;
+        }
 
-        /* Check for events */
-        while (SDL_PollEvent(&event)) {
-            if (event.type == SDL_EVENT_QUIT ||
-                (event.type == SDL_EVENT_KEY_DOWN && event.key.keysym.sym == SDLK_ESCAPE)) {
-                done = 1;
+        /* Act on the input that came in while waiting or decoding */
+        if (pending_input.reset_speed) {
+            SetPlaybackSpeed(1.0);
+        }
+        for (; pending_input.speed_steps < 0; ++pending_input.speed_steps) {
+            StepPlaybackSpeed(-1);
+        }
+        for (; pending_input.speed_steps > 0; --pending_input.speed_steps) {
+            StepPlaybackSpeed(1);
+        }
+        if (pending_input.toggle_pause) {
+            if (!paused) {
+                PausePlayback(video_context);
+            } else if (ResumePlayback(ic, video_stream, audio_context, video_context)) {
+                flushing = SDL_FALSE;
             }
         }
+        if (pending_input.frame_steps != 0 && frame_cache) {
+            /* Stepping needs video that isn't filtered */
+            if (!paused) {
+                PausePlayback(video_context);
+            }
+            for (; pending_input.frame_steps < 0; ++pending_input.frame_steps) {
+                StepVideoBackward(ic, video_stream, video_context, pkt, frame);
+            }
+            for (; pending_input.frame_steps > 0; --pending_input.frame_steps) {
+                StepVideoForward(ic, video_stream, video_context, pkt, frame);
+            }
+        }
+        if (pending_input.capture) {
+            if (!frame_capture) {
+                frame_capture = CreateFrameCapture(CAPTURE_PREFIX, capture_format);
+            }
+            if (!frame_capture) {
+                SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Couldn't start frame capture: %s",
+                            SDL_GetError());
+            }
+            /* While paused, this is the next frame stepped to */
+            capture_requested = SDL_TRUE;
+        }
+        SDL_zero(pending_input);
+
+        if (memory_report && SDL_GetTicks() >= next_memory_report) {
+            LogPlayerMemory(pkt, frame, filtered);
+            next_memory_report = SDL_GetTicks() + MEMORY_REPORT_INTERVAL_MS;
+        }
+
+        if (video_tiles) {
+            timeout = UpdateVideoWall();
+            continue;
+        }
+
+        if (paused) {
+            /* Nothing to do until playback resumes or steps */
+            timeout = -1;
+            continue;
+        }
+
+        /* Audio held back while the ring was full goes in first. If audio has run far enough
+         * ahead of video, don't read more until the device has made room.
+         */
+        SDL_bool audio_backed_up = SDL_FALSE;
+        if (audio_ring && !FlushAudioRing(audio_ring)) {
+            audio_backed_up =
+                (GetAudioRingBacklogMS(audio_ring) * playback_speed >= AUDIO_RING_BACKLOG_MS);
+        }
 
-        if (!flushing) {
-            result = av_read_frame(ic, pkt);
+        if (!flushing && !audio_backed_up) {
+            result = ReadPacket(ic, pkt);
             if (result < 0) {
                 SDL_Log("End of stream, finishing decode\n");
                 if (audio_context) {
@@ -1630,6 +3650,7 @@ int main(int argc, char* argv[])
                 flushing = SDL_TRUE;
             } else {
                 if (pkt->stream_index == audio_stream) {
+                    TRACE_SCOPE("audio send", GetPacketTraceID(pkt));
                     result = avcodec_send_packet(audio_context, pkt);
                     if (result < 0) {
                         SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
@@ -1637,11 +3658,19 @@ int main(int argc, char* argv[])
                                      av_err2str(result));
                     }
                 } else if (pkt->stream_index == video_stream) {
-                    result = avcodec_send_packet(video_context, pkt);
-                    if (result < 0) {
-                        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
-                                     "avcodec_send_packet(video_context) failed: %s",
-                                     av_err2str(result));
+                    if (probe.fast_start && !seen_keyframe && !(pkt->flags & AV_PKT_FLAG_KEY)) {
+                        /* Frames before the first keyframe can't be decoded cleanly */
+                    } else {
+                        seen_keyframe = SDL_TRUE;
+                        TRACE_SCOPE("video send", GetPacketTraceID(pkt));
+                        Uint64 start = SDL_GetPerformanceCounter();
+                        result = avcodec_send_packet(video_context, pkt);
+                        AddVideoStageTime(VIDEO_STAGE_DECODE, start, 0);
+                        if (result < 0) {
+                            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                                         "avcodec_send_packet(video_context) failed: %s",
+                                         av_err2str(result));
+                        }
                     }
                 }
                 av_packet_unref(pkt);
@@ -1650,44 +3679,122 @@ int main(int argc, char* argv[])
 
         decoded = SDL_FALSE;
         if (audio_context) {
+            Uint64 trace_start = BeginTraceEvent();
             while (avcodec_receive_frame(audio_context, frame) >= 0) {
+                EndTraceEvent("audio decode", GetFrameTraceID(frame), trace_start);
+                if (SkipToResumePoint(frame, audio_context->pkt_timebase, &audio_resume_pts)) {
+                    trace_start = BeginTraceEvent();
+                    continue;
+                }
                 HandleAudioFrame(frame);
                 decoded = SDL_TRUE;
+                trace_start = BeginTraceEvent();
             }
-            if (flushing) {
-                /* Let SDL know we're done sending audio */
-                SDL_FlushAudioStream(audio);
+            if (flushing && audio) {
+                /* Running out of audio from here on is expected, once it's all in the ring */
+                HandleAudioFrame(NULL);
+                if (FlushAudioRing(audio_ring)) {
+                    FinishAudioRing(audio_ring);
+                }
             }
         }
         if (video_context) {
+            Uint64 start = SDL_GetPerformanceCounter();
             while (avcodec_receive_frame(video_context, frame) >= 0) {
-                double pts = ((double)frame->pts * video_context->pkt_timebase.num) /
-                             video_context->pkt_timebase.den;
-                if (first_pts < 0.0) {
-                    first_pts = pts;
+                AddVideoStageTime(VIDEO_STAGE_DECODE, start, 1);
+                EndTraceEvent("video decode", GetFrameTraceID(frame), start);
+                CacheVideoFrame(video_context, frame);
+                if (SkipToResumePoint(frame, video_context->pkt_timebase, &video_resume_pts)) {
+                    /* Already seen, up to the frame that was on screen when playback resumed */
+                } else if (!video_filter && low_latency) {
+                    /* Only the newest frame is shown, the ones before it are already late */
+                    if (newest->buf[0]) {
+                        ++video_frames_skipped;
+                        av_frame_unref(newest);
+                    }
+                    av_frame_move_ref(newest, frame);
+                } else if (!video_filter) {
+                    ShowVideoFrame(video_context, frame, &first_pts);
+                } else {
+                    while (!SendVideoFilterFrame(video_filter, frame)) {
+                        /* The filter is backed up, show what it has finished first */
+                        if (ReceiveVideoFilterFrame(video_filter, filtered,
+                                                    VIDEO_FILTER_WAIT_MS)) {
+                            ShowVideoFrame(video_context, filtered, &first_pts);
+                        }
+                    }
                 }
-                pts -= first_pts;
-
-                HandleVideoFrame(frame, pts);
                 decoded = SDL_TRUE;
+                start = SDL_GetPerformanceCounter();
+            }
+            if (newest->buf[0]) {
+                ShowVideoFrame(video_context, newest, &first_pts);
+                av_frame_unref(newest);
+            }
+            if (video_filter) {
+                if (flushing) {
+                    /* Get the frames the filter is holding back */
+                    SendVideoFilterFrame(video_filter, NULL);
+                }
+                while (ReceiveVideoFilterFrame(video_filter, filtered,
+                                               flushing ? VIDEO_FILTER_WAIT_MS : 0)) {
+                    ShowVideoFrame(video_context, filtered, &first_pts);
+                    decoded = SDL_TRUE;
+                }
+                if (flushing && !VideoFilterFinished(video_filter)) {
+                    decoded = SDL_TRUE;
+                }
             }
         } else {
             /* Update video rendering */
             SDL_SetRenderDrawColor(renderer, 0xA0, 0xA0, 0xA0, 0xFF);
             SDL_RenderClear(renderer);
             MoveSprite();
-            SDL_RenderPresent(renderer);
+            PresentRenderer(0);
+            /* Without video, the first frame is the first one presented */
+            FinishStartup();
         }
 
+        if (audio_backed_up) {
+            timeout = GetShorterTimeout(timeout, GetAudioRingRoomMS(audio_ring));
+        }
         if (flushing && !decoded) {
-            if (SDL_GetAudioStreamQueued(audio) > 0) {
-                /* Wait a little bit for the audio to finish */
-                SDL_Delay(10);
+            int queued = audio ? GetAudioRingQueued(audio_ring) : 0;
+            if (queued > 0 && !FlushAudioRing(audio_ring)) {
+                /* Sleep until there's room for the rest of the audio */
+                timeout = GetAudioRingRoomMS(audio_ring);
+            } else if (queued > 0) {
+                /* Sleep while the audio finishes playing */
+                timeout = SDL_max(queued * 1000 / audio_context->sample_rate, 1);
             } else {
                 done = 1;
             }
         }
     }
+    LogSpriteLayerStats(sprites);
+    LogHugePageFrameStats();
+    LogThreadCPUTimes();
+    LogVideoStageStats();
+    LogFrameCacheStats(frame_cache);
+    LogFrameCaptureStats(frame_capture);
+    LogVideoRecorderStats(video_recorder);
+    if (memory_report) {
+        LogPlayerMemory(pkt, frame, filtered);
+    }
+    if (video_frames_skipped > 0) {
+        SDL_Log("Skipped %d late video frames\n", video_frames_skipped);
+    }
+    if (low_latency) {
+        LogLatencyStats("Overall latency", &latency_total);
+        if (audio_frames_dropped > 0) {
+            SDL_Log("Dropped %d audio frames to keep up with the source\n", audio_frames_dropped);
+        }
+    }
+    if (benchmark_file && !WriteBenchmarkResults(benchmark_file, file, video_context,
+                                                 audio_context, benchmark_start)) {
+        return_code = 5;
+        goto quit;
+    }
     return_code = 0;
 quit:
 #ifdef SDL_PLATFORM_WIN32
@@ -1700,13 +3807,51 @@ quit:
         d3d11_device = NULL;
     }
 #endif
-    SDL_free(positions);
-    SDL_free(velocities);
+    /* Finish writing the snapshots and the recording, they were read back from the renderer */
+    DestroyFrameCapture(frame_capture);
+    frame_capture = NULL;
+    DestroyVideoRecorder(video_recorder);
+    video_recorder = NULL;
+    DestroySpriteLayer(sprites);
+    /* Wait for any decode tasks before closing the tiles they work on */
+    DestroyWorkerPool(worker_pool);
+    worker_pool = NULL;
+    CloseVideoWall();
+    SDL_free(files);
+    DestroyVideoFilter(video_filter);
+    video_filter = NULL;
+    DestroyFrameCache(frame_cache);
+    frame_cache = NULL;
+    av_frame_free(&newest);
+    av_frame_free(&filtered);
     av_frame_free(&frame);
     av_packet_free(&pkt);
+    if (!audio_context) {
+        /* We may have bailed out while the audio was still opening */
+        audio_context = WaitForAudioStream();
+    }
     avcodec_free_context(&audio_context);
+    DestroyAudioTempo(audio_tempo);
+    audio_tempo = NULL;
+    if (audio) {
+        /* Stop the stream callback before freeing the ring it reads */
+        SDL_DestroyAudioStream(audio);
+        audio = NULL;
+    }
+    if (audio_ring) {
+        LogAudioRingStats(audio_ring);
+        DestroyAudioRing(audio_ring);
+        audio_ring = NULL;
+    }
     avcodec_free_context(&video_context);
+    if (!ic) {
+        ic = WaitForProbe(&result);
+    }
     avformat_close_input(&ic);
+    DestroyHugePageFrameAllocator();
+    DestroyHWConfigCache(hw_config_cache);
+    StopTrace();
+    StopAsyncLog();
     SDL_DestroyRenderer(renderer);
     if (vulkan_context) {
         DestroyVulkanVideoContext(vulkan_context);
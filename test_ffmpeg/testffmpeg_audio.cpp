@@ -0,0 +1,630 @@
+/*
+  Copyright (C) 1997-2024 Sam Lantinga <slouken@libsdl.org>
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely.
+*/
+#include <SDL3/SDL.h>
+
+extern "C" {
+#include <libavutil/channel_layout.h>
+#include <libavutil/frame.h>
+#include <libavutil/samplefmt.h>
+}
+
+#include "testffmpeg_audio.h"
+#include "testffmpeg_memory.h"
+#include "testffmpeg_trace.h"
+
+/* Sample frames converted at a time on the way into the ring, a multiple of the SIMD width */
+#define AUDIO_CONVERT_FRAMES 256
+
+/* Downmix levels from ITU-R BS.775. The LFE channel is dropped there, since its content is
+ * normally also in the main channels; raise this to fold it into the downmix.
+ */
+#define DOWNMIX_CENTER_LEVEL 0.7071068f
+#define DOWNMIX_SURROUND_LEVEL 0.7071068f
+#define DOWNMIX_LFE_LEVEL 0.0f
+
+#define MAX_DOWNMIX_CHANNELS 2
+
+/* Mix count planar source frames, AUDIO_CONVERT_FRAMES apart, into interleaved output */
+typedef void (*DownmixFunction)(const float* src,
+                                int src_channels,
+                                const float* matrix,
+                                int dst_channels,
+                                float* dst,
+                                int count);
+
+/* A decoded frame that didn't fit in the ring, offset sample frames of it are already written */
+typedef struct HeldAudioFrame
+{
+    AVFrame* frame;
+    int offset;
+    struct HeldAudioFrame* next;
+} HeldAudioFrame;
+
+struct AudioRing
+{
+    int channels;
+    int freq;
+
+    /* Set when the source has more channels than the device, mixing them down before queuing */
+    int src_channels;
+    float* matrix; /* dst_channels rows of src_channels coefficients */
+    float* planar; /* src_channels planes of AUDIO_CONVERT_FRAMES samples */
+    DownmixFunction downmix;
+
+    int capacity; /* in sample frames */
+    float* samples;
+
+    /* Free running sample frame counters, the reader is the audio callback */
+    SDL_AtomicInt write_pos;
+    SDL_AtomicInt read_pos;
+    SDL_AtomicInt finished;
+
+    /* Only touched by the audio callback, read after the device is closed */
+    int callbacks;
+    int underruns;
+    int min_depth;
+    int max_depth;
+    Uint64 total_depth;
+
+    /* Only touched by the decoder */
+    HeldAudioFrame* held_head;
+    HeldAudioFrame* held_tail;
+    int held_frames; /* sample frames not yet written */
+    int dropped_frames;
+    SDL_bool warned_format;
+};
+
+/* Which way a channel leans in a stereo downmix, and how loud it is */
+static void GetDownmixGains(enum AVChannel channel, float* left, float* right)
+{
+    switch (channel) {
+        case AV_CHAN_FRONT_LEFT:
+        case AV_CHAN_FRONT_LEFT_OF_CENTER:
+        case AV_CHAN_WIDE_LEFT:
+        case AV_CHAN_STEREO_LEFT:
+            *left = 1.0f;
+            *right = 0.0f;
+            break;
+        case AV_CHAN_FRONT_RIGHT:
+        case AV_CHAN_FRONT_RIGHT_OF_CENTER:
+        case AV_CHAN_WIDE_RIGHT:
+        case AV_CHAN_STEREO_RIGHT:
+            *left = 0.0f;
+            *right = 1.0f;
+            break;
+        case AV_CHAN_FRONT_CENTER:
+            *left = DOWNMIX_CENTER_LEVEL;
+            *right = DOWNMIX_CENTER_LEVEL;
+            break;
+        case AV_CHAN_LOW_FREQUENCY:
+        case AV_CHAN_LOW_FREQUENCY_2:
+            *left = DOWNMIX_LFE_LEVEL;
+            *right = DOWNMIX_LFE_LEVEL;
+            break;
+        case AV_CHAN_BACK_LEFT:
+        case AV_CHAN_SIDE_LEFT:
+        case AV_CHAN_SURROUND_DIRECT_LEFT:
+        case AV_CHAN_TOP_FRONT_LEFT:
+        case AV_CHAN_TOP_BACK_LEFT:
+        case AV_CHAN_TOP_SIDE_LEFT:
+        case AV_CHAN_BOTTOM_FRONT_LEFT:
+            *left = DOWNMIX_SURROUND_LEVEL;
+            *right = 0.0f;
+            break;
+        case AV_CHAN_BACK_RIGHT:
+        case AV_CHAN_SIDE_RIGHT:
+        case AV_CHAN_SURROUND_DIRECT_RIGHT:
+        case AV_CHAN_TOP_FRONT_RIGHT:
+        case AV_CHAN_TOP_BACK_RIGHT:
+        case AV_CHAN_TOP_SIDE_RIGHT:
+        case AV_CHAN_BOTTOM_FRONT_RIGHT:
+            *left = 0.0f;
+            *right = DOWNMIX_SURROUND_LEVEL;
+            break;
+        default:
+            /* Back and top centers, and anything we don't know, go equally to both sides */
+            *left = DOWNMIX_SURROUND_LEVEL * DOWNMIX_CENTER_LEVEL;
+            *right = DOWNMIX_SURROUND_LEVEL * DOWNMIX_CENTER_LEVEL;
+            break;
+    }
+}
+
+static void BuildDownmixMatrix(const AVChannelLayout* layout, int dst_channels, float* matrix)
+{
+    AVChannelLayout default_layout;
+    int src_channels = layout->nb_channels;
+    float max_sum = 0.0f;
+
+    if (layout->order == AV_CHANNEL_ORDER_UNSPEC) {
+        /* Guess the usual layout for the channel count */
+        av_channel_layout_default(&default_layout, src_channels);
+        layout = &default_layout;
+    }
+
+    for (int c = 0; c < src_channels; ++c) {
+        float left, right;
+
+        GetDownmixGains(av_channel_layout_channel_from_index(layout, c), &left, &right);
+        if (dst_channels == 1) {
+            matrix[c] = 0.5f * (left + right);
+        } else {
+            matrix[c] = left;
+            matrix[src_channels + c] = right;
+        }
+    }
+
+    /* Scale so a full scale signal on every channel can't clip */
+    for (int d = 0; d < dst_channels; ++d) {
+        float sum = 0.0f;
+        for (int c = 0; c < src_channels; ++c) {
+            sum += matrix[d * src_channels + c];
+        }
+        max_sum = SDL_max(max_sum, sum);
+    }
+    if (max_sum > 1.0f) {
+        for (int i = 0; i < dst_channels * src_channels; ++i) {
+            matrix[i] /= max_sum;
+        }
+    }
+
+    if (layout == &default_layout) {
+        av_channel_layout_uninit(&default_layout);
+    }
+}
+
+static void Downmix_Scalar(const float* src,
+                           int src_channels,
+                           const float* matrix,
+                           int dst_channels,
+                           float* dst,
+                           int count)
+{
+    for (int n = 0; n < count; ++n) {
+        for (int d = 0; d < dst_channels; ++d) {
+            const float* row = &matrix[d * src_channels];
+            float sum = 0.0f;
+            for (int c = 0; c < src_channels; ++c) {
+                sum += row[c] * src[c * AUDIO_CONVERT_FRAMES + n];
+            }
+            dst[n * dst_channels + d] = sum;
+        }
+    }
+}
+
+#ifdef SDL_SSE2_INTRINSICS
+static void SDL_TARGETING("sse2") Downmix_SSE2(const float* src,
+                                               int src_channels,
+                                               const float* matrix,
+                                               int dst_channels,
+                                               float* dst,
+                                               int count)
+{
+    const float* right_row = &matrix[(dst_channels - 1) * src_channels];
+    int n;
+
+    /* Four sample frames at a time, accumulating each output channel across the source planes */
+    for (n = 0; n + 4 <= count; n += 4) {
+        __m128 left = _mm_setzero_ps();
+        __m128 right = _mm_setzero_ps();
+        for (int c = 0; c < src_channels; ++c) {
+            __m128 x = _mm_load_ps(&src[c * AUDIO_CONVERT_FRAMES + n]);
+            left = _mm_add_ps(left, _mm_mul_ps(_mm_set1_ps(matrix[c]), x));
+            right = _mm_add_ps(right, _mm_mul_ps(_mm_set1_ps(right_row[c]), x));
+        }
+        if (dst_channels == 2) {
+            _mm_storeu_ps(&dst[n * 2], _mm_unpacklo_ps(left, right));
+            _mm_storeu_ps(&dst[n * 2 + 4], _mm_unpackhi_ps(left, right));
+        } else {
+            _mm_storeu_ps(&dst[n], left);
+        }
+    }
+    Downmix_Scalar(src + n, src_channels, matrix, dst_channels, dst + n * dst_channels,
+                   count - n);
+}
+#endif
+
+#ifdef SDL_NEON_INTRINSICS
+static void Downmix_NEON(const float* src,
+                         int src_channels,
+                         const float* matrix,
+                         int dst_channels,
+                         float* dst,
+                         int count)
+{
+    const float* right_row = &matrix[(dst_channels - 1) * src_channels];
+    int n;
+
+    for (n = 0; n + 4 <= count; n += 4) {
+        float32x4x2_t out;
+        out.val[0] = vdupq_n_f32(0.0f);
+        out.val[1] = vdupq_n_f32(0.0f);
+        for (int c = 0; c < src_channels; ++c) {
+            float32x4_t x = vld1q_f32(&src[c * AUDIO_CONVERT_FRAMES + n]);
+            out.val[0] = vmlaq_n_f32(out.val[0], x, matrix[c]);
+            out.val[1] = vmlaq_n_f32(out.val[1], x, right_row[c]);
+        }
+        if (dst_channels == 2) {
+            vst2q_f32(&dst[n * 2], out);
+        } else {
+            vst1q_f32(&dst[n], out.val[0]);
+        }
+    }
+    Downmix_Scalar(src + n, src_channels, matrix, dst_channels, dst + n * dst_channels,
+                   count - n);
+}
+#endif
+
+static DownmixFunction GetDownmixFunction(void)
+{
+#ifdef SDL_SSE2_INTRINSICS
+    if (SDL_HasSSE2()) {
+        return Downmix_SSE2;
+    }
+#endif
+#ifdef SDL_NEON_INTRINSICS
+    if (SDL_HasNEON()) {
+        return Downmix_NEON;
+    }
+#endif
+    return Downmix_Scalar;
+}
+
+AudioRing* CreateAudioRing(const AVChannelLayout* layout,
+                           int device_channels,
+                           int freq,
+                           int capacity_ms)
+{
+    AudioRing* ring = (AudioRing*)SDL_calloc(1, sizeof(*ring));
+    if (!ring) {
+        return NULL;
+    }
+
+    ring->src_channels = layout->nb_channels;
+    ring->channels = layout->nb_channels;
+    ring->freq = freq;
+    if (device_channels > 0 && device_channels <= MAX_DOWNMIX_CHANNELS &&
+        layout->nb_channels > device_channels) {
+        ring->channels = device_channels;
+        ring->matrix =
+            (float*)SDL_malloc((size_t)device_channels * layout->nb_channels * sizeof(float));
+        ring->planar = (float*)SDL_aligned_alloc(
+            SDL_SIMDGetAlignment(),
+            (size_t)layout->nb_channels * AUDIO_CONVERT_FRAMES * sizeof(float));
+        if (!ring->matrix || !ring->planar) {
+            DestroyAudioRing(ring);
+            return NULL;
+        }
+        BuildDownmixMatrix(layout, device_channels, ring->matrix);
+        ring->downmix = GetDownmixFunction();
+    }
+
+    ring->capacity = SDL_max((int)((Sint64)freq * capacity_ms / 1000), 1);
+    ring->samples = (float*)SDL_malloc((size_t)ring->capacity * ring->channels * sizeof(float));
+    if (!ring->samples) {
+        DestroyAudioRing(ring);
+        return NULL;
+    }
+    ring->min_depth = ring->capacity;
+    return ring;
+}
+
+int GetAudioRingChannels(AudioRing* ring)
+{
+    return ring->channels;
+}
+
+static int GetQueuedFrames(AudioRing* ring)
+{
+    return (int)((Uint32)SDL_AtomicGet(&ring->write_pos) - (Uint32)SDL_AtomicGet(&ring->read_pos));
+}
+
+void SDLCALL AudioRingStreamCallback(void* userdata,
+                                     SDL_AudioStream* stream,
+                                     int additional_amount,
+                                     int total_amount)
+{
+    TRACE_SCOPE("audio callback");
+    AudioRing* ring = (AudioRing*)userdata;
+    int framesize = ring->channels * (int)sizeof(float);
+    int wanted = additional_amount / framesize;
+    int queued = GetQueuedFrames(ring);
+    int count = SDL_min(wanted, queued);
+    Uint32 read_pos = (Uint32)SDL_AtomicGet(&ring->read_pos);
+
+    (void)total_amount;
+
+    if (wanted <= 0) {
+        return;
+    }
+
+    ++ring->callbacks;
+    ring->total_depth += queued;
+    ring->min_depth = SDL_min(ring->min_depth, queued);
+    ring->max_depth = SDL_max(ring->max_depth, queued);
+    if (count < wanted && !SDL_AtomicGet(&ring->finished)) {
+        /* SDL plays silence for the rest */
+        ++ring->underruns;
+    }
+
+    while (count > 0) {
+        int offset = (int)(read_pos % (Uint32)ring->capacity);
+        int amount = SDL_min(count, ring->capacity - offset);
+
+        SDL_PutAudioStreamData(stream, &ring->samples[offset * ring->channels],
+                               amount * framesize);
+        read_pos += amount;
+        count -= amount;
+    }
+    SDL_AtomicSet(&ring->read_pos, (int)read_pos);
+}
+
+static float ReadSample(const Uint8* data, int index, enum AVSampleFormat format)
+{
+    switch (format) {
+        case AV_SAMPLE_FMT_U8:
+        case AV_SAMPLE_FMT_U8P:
+            return (data[index] - 128) * (1.0f / 128.0f);
+        case AV_SAMPLE_FMT_S16:
+        case AV_SAMPLE_FMT_S16P:
+            return ((const Sint16*)data)[index] * (1.0f / 32768.0f);
+        case AV_SAMPLE_FMT_S32:
+        case AV_SAMPLE_FMT_S32P:
+            return ((const Sint32*)data)[index] * (1.0f / 2147483648.0f);
+        case AV_SAMPLE_FMT_FLT:
+        case AV_SAMPLE_FMT_FLTP:
+            return ((const float*)data)[index];
+        case AV_SAMPLE_FMT_DBL:
+        case AV_SAMPLE_FMT_DBLP:
+            return (float)((const double*)data)[index];
+        case AV_SAMPLE_FMT_S64:
+        case AV_SAMPLE_FMT_S64P:
+            return (float)(((const Sint64*)data)[index] * (1.0 / 9223372036854775808.0));
+        default:
+            return 0.0f;
+    }
+}
+
+/* Convert sample frames [start, start + count) of the frame into float planes */
+static void ConvertAudioPlanar(const AVFrame* frame, int start, int count, float* dst)
+{
+    enum AVSampleFormat format = (enum AVSampleFormat)frame->format;
+    int channels = frame->ch_layout.nb_channels;
+
+    for (int c = 0; c < channels; ++c) {
+        float* plane = &dst[c * AUDIO_CONVERT_FRAMES];
+
+        if (format == AV_SAMPLE_FMT_FLTP) {
+            SDL_memcpy(plane, (const float*)frame->extended_data[c] + start,
+                       (size_t)count * sizeof(float));
+        } else if (av_sample_fmt_is_planar(format)) {
+            for (int n = 0; n < count; ++n) {
+                plane[n] = ReadSample(frame->extended_data[c], start + n, format);
+            }
+        } else {
+            for (int n = 0; n < count; ++n) {
+                plane[n] = ReadSample(frame->data[0], (start + n) * channels + c, format);
+            }
+        }
+    }
+}
+
+/* Convert sample frames [start, start + count) of the frame into interleaved floats */
+static void ConvertAudio(const AVFrame* frame, int start, int count, float* dst)
+{
+    enum AVSampleFormat format = (enum AVSampleFormat)frame->format;
+    int channels = frame->ch_layout.nb_channels;
+
+    if (format == AV_SAMPLE_FMT_FLT) {
+        SDL_memcpy(dst, (const float*)frame->data[0] + start * channels,
+                   (size_t)count * channels * sizeof(float));
+    } else if (av_sample_fmt_is_planar(format)) {
+        for (int c = 0; c < channels; ++c) {
+            const Uint8* src = frame->extended_data[c];
+            for (int n = 0; n < count; ++n) {
+                dst[n * channels + c] = ReadSample(src, start + n, format);
+            }
+        }
+    } else {
+        const Uint8* src = frame->data[0];
+        for (int n = 0; n < count * channels; ++n) {
+            dst[n] = ReadSample(src, start * channels + n, format);
+        }
+    }
+}
+
+/* Write sample frames from start on until the ring is full, returns how many were written */
+static int WriteAudioFrames(AudioRing* ring, const AVFrame* frame, int start)
+{
+    int remaining = frame->nb_samples - start;
+    int written = 0;
+
+    while (remaining > 0) {
+        int space = ring->capacity - GetQueuedFrames(ring);
+        if (space == 0) {
+            break;
+        }
+
+        Uint32 write_pos = (Uint32)SDL_AtomicGet(&ring->write_pos);
+        int offset = (int)(write_pos % (Uint32)ring->capacity);
+        int count = SDL_min(SDL_min(remaining, space), ring->capacity - offset);
+        count = SDL_min(count, AUDIO_CONVERT_FRAMES);
+
+        if (ring->downmix) {
+            ConvertAudioPlanar(frame, start, count, ring->planar);
+            ring->downmix(ring->planar, ring->src_channels, ring->matrix, ring->channels,
+                          &ring->samples[offset * ring->channels], count);
+        } else {
+            ConvertAudio(frame, start, count, &ring->samples[offset * ring->channels]);
+        }
+        SDL_AtomicSet(&ring->write_pos, (int)(write_pos + count));
+        start += count;
+        remaining -= count;
+        written += count;
+    }
+    return written;
+}
+
+static void FreeHeldAudio(AudioRing* ring)
+{
+    while (ring->held_head) {
+        HeldAudioFrame* held = ring->held_head;
+        ring->held_head = held->next;
+        av_frame_free(&held->frame);
+        SDL_free(held);
+    }
+    ring->held_tail = NULL;
+    ring->held_frames = 0;
+}
+
+void WriteAudioRing(AudioRing* ring, const AVFrame* frame)
+{
+    int written = 0;
+
+    if (frame->ch_layout.nb_channels != ring->src_channels || frame->sample_rate != ring->freq) {
+        if (!ring->warned_format) {
+            SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                        "Audio changed to %d channels, %d Hz mid-stream, dropping it",
+                        frame->ch_layout.nb_channels, frame->sample_rate);
+            ring->warned_format = SDL_TRUE;
+        }
+        ring->dropped_frames += frame->nb_samples;
+        return;
+    }
+
+    /* Audio that's already held back goes first */
+    if (!ring->held_head) {
+        written = WriteAudioFrames(ring, frame, 0);
+        if (written == frame->nb_samples) {
+            return;
+        }
+    }
+
+    /* The device sets the pace, keep the rest until it has played enough to make room */
+    HeldAudioFrame* held = (HeldAudioFrame*)SDL_calloc(1, sizeof(*held));
+    if (held) {
+        held->frame = av_frame_clone(frame);
+    }
+    if (!held || !held->frame) {
+        SDL_free(held);
+        ring->dropped_frames += frame->nb_samples - written;
+        return;
+    }
+    held->offset = written;
+    if (ring->held_tail) {
+        ring->held_tail->next = held;
+    } else {
+        ring->held_head = held;
+    }
+    ring->held_tail = held;
+    ring->held_frames += frame->nb_samples - written;
+}
+
+SDL_bool FlushAudioRing(AudioRing* ring)
+{
+    while (ring->held_head) {
+        HeldAudioFrame* held = ring->held_head;
+        int written = WriteAudioFrames(ring, held->frame, held->offset);
+
+        held->offset += written;
+        ring->held_frames -= written;
+        if (held->offset < held->frame->nb_samples) {
+            return SDL_FALSE;
+        }
+        ring->held_head = held->next;
+        if (!ring->held_head) {
+            ring->held_tail = NULL;
+        }
+        av_frame_free(&held->frame);
+        SDL_free(held);
+    }
+    return SDL_TRUE;
+}
+
+int GetAudioRingBacklogMS(AudioRing* ring)
+{
+    return (int)((Sint64)ring->held_frames * 1000 / ring->freq);
+}
+
+Sint32 GetAudioRingRoomMS(AudioRing* ring)
+{
+    /* Wait for a quarter of the ring, flushing a few samples at a time isn't worth waking for */
+    int wanted = ring->capacity / 4 - (ring->capacity - GetQueuedFrames(ring));
+    if (wanted <= 0) {
+        return 0;
+    }
+    return (Sint32)SDL_max((Sint64)wanted * 1000 / ring->freq, 1);
+}
+
+void FinishAudioRing(AudioRing* ring)
+{
+    SDL_AtomicSet(&ring->finished, 1);
+}
+
+void ClearAudioRing(AudioRing* ring)
+{
+    FreeHeldAudio(ring);
+
+    /* The callback is the only other reader, and it isn't running */
+    SDL_AtomicSet(&ring->read_pos, SDL_AtomicGet(&ring->write_pos));
+    SDL_AtomicSet(&ring->finished, 0);
+}
+
+int GetAudioRingQueued(AudioRing* ring)
+{
+    return GetQueuedFrames(ring);
+}
+
+void AddAudioRingMemory(AudioRing* ring, MemoryReport* report)
+{
+    if (!ring) {
+        return;
+    }
+
+    Uint64 bytes = (Uint64)ring->capacity * ring->channels * sizeof(float);
+    if (ring->planar) {
+        bytes += (Uint64)ring->src_channels * AUDIO_CONVERT_FRAMES * sizeof(float);
+    }
+    for (HeldAudioFrame* held = ring->held_head; held; held = held->next) {
+        bytes += (Uint64)av_samples_get_buffer_size(NULL, held->frame->ch_layout.nb_channels,
+                                                    held->frame->nb_samples,
+                                                    (enum AVSampleFormat)held->frame->format, 1);
+    }
+    AddMemory(report, MEMORY_AUDIO, bytes);
+    report->audio_ring_queued = (Uint64)GetQueuedFrames(ring) * ring->channels * sizeof(float);
+}
+
+void LogAudioRingStats(AudioRing* ring)
+{
+    double ms_per_frame = 1000.0 / ring->freq;
+
+    if (!ring->callbacks) {
+        return;
+    }
+    SDL_Log("Audio ring: depth %.1f ms average, %.1f - %.1f ms, %d underruns in %d callbacks\n",
+            (double)ring->total_depth / ring->callbacks * ms_per_frame,
+            ring->min_depth * ms_per_frame, ring->max_depth * ms_per_frame, ring->underruns,
+            ring->callbacks);
+    if (ring->dropped_frames) {
+        SDL_Log("Audio ring: dropped %.1f ms of audio\n", ring->dropped_frames * ms_per_frame);
+    }
+}
+
+void DestroyAudioRing(AudioRing* ring)
+{
+    if (ring) {
+        FreeHeldAudio(ring);
+        SDL_free(ring->samples);
+        SDL_free(ring->matrix);
+        SDL_aligned_free(ring->planar);
+        SDL_free(ring);
+    }
+}
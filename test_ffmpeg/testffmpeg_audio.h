@@ -0,0 +1,77 @@
+/*
+  Copyright (C) 1997-2024 Sam Lantinga <slouken@libsdl.org>
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely.
+*/
+
+extern "C" {
+#include <libavutil/channel_layout.h>
+#include <libavutil/frame.h>
+}
+
+/* Decoded audio waiting for the audio device, as interleaved float samples. The decoder writes
+ * into it and the audio stream callback pulls exactly as much as the device asks for.
+ */
+typedef struct AudioRing AudioRing;
+
+typedef struct MemoryReport MemoryReport;
+
+/* What the device can play without the decoder keeping up. Audio decoded while it's full is
+ * held back, see FlushAudioRing().
+ */
+#define AUDIO_RING_CAPACITY_MS 500
+
+/* How far, in source time, audio can run ahead of video in the file before reading more packets
+ * should wait for the device to make room
+ */
+#define AUDIO_RING_BACKLOG_MS 2000
+
+/* Sources with more channels than a mono or stereo device are mixed down on the way in */
+extern AudioRing* CreateAudioRing(const AVChannelLayout* layout,
+                                  int device_channels,
+                                  int freq,
+                                  int capacity_ms);
+
+/* The channel count of the audio in the ring, the audio stream input format */
+extern int GetAudioRingChannels(AudioRing* ring);
+
+/* Pass the ring as the userdata of SDL_OpenAudioDeviceStream() */
+extern void SDLCALL AudioRingStreamCallback(void* userdata,
+                                            SDL_AudioStream* stream,
+                                            int additional_amount,
+                                            int total_amount);
+
+/* Convert and queue a decoded frame. What doesn't fit is held back rather than waiting for the
+ * device, so this never blocks the render thread.
+ */
+extern void WriteAudioRing(AudioRing* ring, const AVFrame* frame);
+
+/* Write as much of the held back audio as fits, returns SDL_TRUE when none is left */
+extern SDL_bool FlushAudioRing(AudioRing* ring);
+
+/* How much audio is held back, in milliseconds as queued */
+extern int GetAudioRingBacklogMS(AudioRing* ring);
+
+/* How long until the device has played enough to be worth flushing more */
+extern Sint32 GetAudioRingRoomMS(AudioRing* ring);
+
+/* No more audio is coming, running dry after this isn't an underrun. Call it once
+ * FlushAudioRing() has written everything.
+ */
+extern void FinishAudioRing(AudioRing* ring);
+
+/* Drop everything waiting to be played, only while the device is paused */
+extern void ClearAudioRing(AudioRing* ring);
+
+/* The number of sample frames waiting to be played */
+extern int GetAudioRingQueued(AudioRing* ring);
+
+extern void AddAudioRingMemory(AudioRing* ring, MemoryReport* report);
+extern void LogAudioRingStats(AudioRing* ring);
+extern void DestroyAudioRing(AudioRing* ring);
@@ -0,0 +1,344 @@
+/*
+  Copyright (C) 1997-2024 Sam Lantinga <slouken@libsdl.org>
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely.
+*/
+#include <SDL3/SDL.h>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/imgutils.h>
+}
+
+#include "testffmpeg_capture.h"
+#include "testffmpeg_cpu.h"
+#include "testffmpeg_memory.h"
+#include "testffmpeg_trace.h"
+
+typedef struct StagedCapture
+{
+    SDL_Surface* surface;
+    int frame;
+} StagedCapture;
+
+struct FrameCapture
+{
+    char* prefix;
+    FrameCaptureFormat format;
+    SDL_Thread* thread;
+
+    /* Protected by lock */
+    SDL_Mutex* lock;
+    SDL_Condition* staged_ready;
+    StagedCapture staged[FRAME_CAPTURE_SURFACES];
+    int head;
+    int count;
+    SDL_bool quit;
+    int written;
+    int failed;
+    Uint64 write_ticks;
+
+    /* Only used by the render thread */
+    int skipped;
+    int read_back;
+    Uint64 read_ticks;
+
+    /* Only used by the capture thread */
+    AVCodecContext* png;
+    AVFrame* frame;
+    AVPacket* pkt;
+};
+
+/* Open the PNG encoder for this size, it's kept for as long as the size doesn't change */
+static SDL_bool OpenCaptureEncoder(FrameCapture* capture, int width, int height)
+{
+    if (capture->png && capture->png->width == width && capture->png->height == height) {
+        return SDL_TRUE;
+    }
+    avcodec_free_context(&capture->png);
+    av_frame_unref(capture->frame);
+
+    const AVCodec* codec = avcodec_find_encoder(AV_CODEC_ID_PNG);
+    if (!codec) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Couldn't find a PNG encoder");
+        return SDL_FALSE;
+    }
+    capture->png = avcodec_alloc_context3(codec);
+    if (!capture->png) {
+        return SDL_FALSE;
+    }
+    capture->png->width = width;
+    capture->png->height = height;
+    capture->png->pix_fmt = AV_PIX_FMT_RGB24;
+    capture->png->time_base = AVRational{1, 1};
+    int result = avcodec_open2(capture->png, codec, NULL);
+    if (result < 0) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Couldn't open PNG encoder: %d", result);
+        avcodec_free_context(&capture->png);
+        return SDL_FALSE;
+    }
+
+    capture->frame->format = AV_PIX_FMT_RGB24;
+    capture->frame->width = width;
+    capture->frame->height = height;
+    if (av_frame_get_buffer(capture->frame, 0) < 0) {
+        avcodec_free_context(&capture->png);
+        return SDL_FALSE;
+    }
+    return SDL_TRUE;
+}
+
+static SDL_bool WriteCapturePNG(FrameCapture* capture, SDL_Surface* rgb, SDL_IOStream* io)
+{
+    if (!OpenCaptureEncoder(capture, rgb->w, rgb->h) ||
+        av_frame_make_writable(capture->frame) < 0) {
+        return SDL_FALSE;
+    }
+    av_image_copy_plane(capture->frame->data[0], capture->frame->linesize[0],
+                        (const uint8_t*)rgb->pixels, rgb->pitch, rgb->w * 3, rgb->h);
+
+    int result = avcodec_send_frame(capture->png, capture->frame);
+    if (result < 0) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Couldn't encode PNG: %d", result);
+        return SDL_FALSE;
+    }
+    SDL_bool written = SDL_TRUE;
+    while (avcodec_receive_packet(capture->png, capture->pkt) >= 0) {
+        if (SDL_WriteIO(io, capture->pkt->data, capture->pkt->size) != (size_t)capture->pkt->size) {
+            written = SDL_FALSE;
+        }
+        av_packet_unref(capture->pkt);
+    }
+    return written;
+}
+
+static SDL_bool WriteCaptureRaw(SDL_Surface* rgb, SDL_IOStream* io)
+{
+    const Uint8* row = (const Uint8*)rgb->pixels;
+    size_t row_size = (size_t)rgb->w * 3;
+
+    for (int y = 0; y < rgb->h; ++y, row += rgb->pitch) {
+        if (SDL_WriteIO(io, row, row_size) != row_size) {
+            return SDL_FALSE;
+        }
+    }
+    return SDL_TRUE;
+}
+
+static SDL_bool WriteCapture(FrameCapture* capture, const StagedCapture* staged)
+{
+    char path[1024];
+    SDL_bool written;
+
+    SDL_Surface* rgb = SDL_ConvertSurfaceFormat(staged->surface, SDL_PIXELFORMAT_RGB24);
+    if (!rgb) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Couldn't convert capture: %s",
+                     SDL_GetError());
+        return SDL_FALSE;
+    }
+
+    if (capture->format == FRAME_CAPTURE_RAW) {
+        SDL_snprintf(path, sizeof(path), "%s-%06d-%dx%d.rgb", capture->prefix, staged->frame,
+                     rgb->w, rgb->h);
+    } else {
+        SDL_snprintf(path, sizeof(path), "%s-%06d.png", capture->prefix, staged->frame);
+    }
+    SDL_IOStream* io = SDL_IOFromFile(path, "wb");
+    if (!io) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Couldn't create %s: %s", path, SDL_GetError());
+        SDL_DestroySurface(rgb);
+        return SDL_FALSE;
+    }
+    if (capture->format == FRAME_CAPTURE_RAW) {
+        written = WriteCaptureRaw(rgb, io);
+    } else {
+        written = WriteCapturePNG(capture, rgb, io);
+    }
+    if (SDL_CloseIO(io) < 0) {
+        written = SDL_FALSE;
+    }
+    SDL_DestroySurface(rgb);
+
+    if (!written) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Couldn't write %s", path);
+        return SDL_FALSE;
+    }
+    SDL_Log("Captured frame %d to %s\n", staged->frame, path);
+    return SDL_TRUE;
+}
+
+static int SDLCALL FrameCaptureThread(void* data)
+{
+    FrameCapture* capture = (FrameCapture*)data;
+
+    /* A capture can be started from the render thread after it has been pinned */
+    UnpinCurrentThread();
+    SetTraceThreadName("capture");
+
+    SDL_LockMutex(capture->lock);
+    for (;;) {
+        while (capture->count == 0 && !capture->quit) {
+            SDL_WaitCondition(capture->staged_ready, capture->lock);
+        }
+        if (capture->count == 0) {
+            /* Everything that was read back has been written */
+            break;
+        }
+        StagedCapture* staged = &capture->staged[capture->head];
+        SDL_UnlockMutex(capture->lock);
+
+        Uint64 start = SDL_GetPerformanceCounter();
+        SDL_bool written;
+        {
+            TRACE_SCOPE("capture write");
+            written = WriteCapture(capture, staged);
+        }
+        SDL_DestroySurface(staged->surface);
+        staged->surface = NULL;
+
+        SDL_LockMutex(capture->lock);
+        /* The staging surface is free for the render thread again */
+        capture->head = (capture->head + 1) % FRAME_CAPTURE_SURFACES;
+        --capture->count;
+        capture->write_ticks += SDL_GetPerformanceCounter() - start;
+        if (written) {
+            ++capture->written;
+        } else {
+            ++capture->failed;
+        }
+    }
+    SDL_UnlockMutex(capture->lock);
+    return 0;
+}
+
+FrameCapture* CreateFrameCapture(const char* prefix, FrameCaptureFormat format)
+{
+    FrameCapture* capture = static_cast<FrameCapture*>(SDL_calloc(1, sizeof(*capture)));
+    if (!capture) {
+        return NULL;
+    }
+    capture->prefix = SDL_strdup(prefix);
+    capture->format = format;
+    capture->lock = SDL_CreateMutex();
+    capture->staged_ready = SDL_CreateCondition();
+    capture->frame = av_frame_alloc();
+    capture->pkt = av_packet_alloc();
+    if (!capture->prefix || !capture->lock || !capture->staged_ready || !capture->frame ||
+        !capture->pkt) {
+        DestroyFrameCapture(capture);
+        return NULL;
+    }
+
+    capture->thread = SDL_CreateThread(FrameCaptureThread, "capture", capture);
+    if (!capture->thread) {
+        DestroyFrameCapture(capture);
+        return NULL;
+    }
+    return capture;
+}
+
+SDL_bool FrameCaptureHasRoom(FrameCapture* capture)
+{
+    SDL_LockMutex(capture->lock);
+    SDL_bool full = (capture->count == FRAME_CAPTURE_SURFACES) ? SDL_TRUE : SDL_FALSE;
+    SDL_UnlockMutex(capture->lock);
+    if (full) {
+        ++capture->skipped;
+        return SDL_FALSE;
+    }
+    return SDL_TRUE;
+}
+
+void CaptureFrameSurface(FrameCapture* capture, SDL_Surface* surface, int frame, Uint64 read_ticks)
+{
+    capture->read_ticks += read_ticks;
+    if (!surface) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Couldn't read back frame %d: %s", frame,
+                    SDL_GetError());
+        ++capture->skipped;
+        return;
+    }
+    ++capture->read_back;
+
+    /* Only the render thread adds snapshots, so the surface FrameCaptureHasRoom() found is
+     * still free
+     */
+    SDL_LockMutex(capture->lock);
+    int tail = (capture->head + capture->count) % FRAME_CAPTURE_SURFACES;
+    capture->staged[tail].surface = surface;
+    capture->staged[tail].frame = frame;
+    ++capture->count;
+    SDL_SignalCondition(capture->staged_ready);
+    SDL_UnlockMutex(capture->lock);
+}
+
+void AddFrameCaptureMemory(FrameCapture* capture, MemoryReport* report)
+{
+    if (!capture) {
+        return;
+    }
+
+    SDL_LockMutex(capture->lock);
+    for (int i = 0; i < capture->count; ++i) {
+        int index = (capture->head + i) % FRAME_CAPTURE_SURFACES;
+        SDL_Surface* surface = capture->staged[index].surface;
+        AddMemory(report, MEMORY_FRAMES, (Uint64)surface->pitch * surface->h);
+    }
+    SDL_UnlockMutex(capture->lock);
+}
+
+void LogFrameCaptureStats(FrameCapture* capture)
+{
+    if (!capture || capture->read_back + capture->skipped == 0) {
+        return;
+    }
+
+    double frequency = (double)SDL_GetPerformanceFrequency();
+    SDL_LockMutex(capture->lock);
+    SDL_Log("Frame capture: %d written, %d failed, %d skipped, %.2f ms read back, %.2f ms "
+            "written per frame\n",
+            capture->written, capture->failed, capture->skipped,
+            capture->read_back ? capture->read_ticks * 1000.0 / frequency / capture->read_back
+                               : 0.0,
+            capture->written + capture->failed
+                ? capture->write_ticks * 1000.0 / frequency / (capture->written + capture->failed)
+                : 0.0);
+    SDL_UnlockMutex(capture->lock);
+}
+
+void DestroyFrameCapture(FrameCapture* capture)
+{
+    if (!capture) {
+        return;
+    }
+
+    if (capture->thread) {
+        SDL_LockMutex(capture->lock);
+        capture->quit = SDL_TRUE;
+        SDL_SignalCondition(capture->staged_ready);
+        SDL_UnlockMutex(capture->lock);
+        SDL_WaitThread(capture->thread, NULL);
+    }
+    for (int i = 0; i < FRAME_CAPTURE_SURFACES; ++i) {
+        if (capture->staged[i].surface) {
+            SDL_DestroySurface(capture->staged[i].surface);
+        }
+    }
+    avcodec_free_context(&capture->png);
+    av_frame_free(&capture->frame);
+    av_packet_free(&capture->pkt);
+    if (capture->staged_ready) {
+        SDL_DestroyCondition(capture->staged_ready);
+    }
+    if (capture->lock) {
+        SDL_DestroyMutex(capture->lock);
+    }
+    SDL_free(capture->prefix);
+    SDL_free(capture);
+}
@@ -0,0 +1,51 @@
+/*
+  Copyright (C) 1997-2024 Sam Lantinga <slouken@libsdl.org>
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely.
+*/
+
+/* Snapshots of the composited output, video and sprites together. The render thread only reads
+ * the pixels back into a staging surface, converting, encoding and writing the file happen on
+ * a capture thread. While one snapshot is being written the next can be read back into the
+ * other staging surface, and if both are still busy the snapshot is skipped and counted rather
+ * than making the render loop wait for the disk.
+ */
+typedef struct FrameCapture FrameCapture;
+
+#define FRAME_CAPTURE_SURFACES 2
+
+typedef enum FrameCaptureFormat
+{
+    FRAME_CAPTURE_PNG, /* <prefix>-<frame>.png */
+    FRAME_CAPTURE_RAW  /* <prefix>-<frame>-<width>x<height>.rgb, packed RGB24 */
+} FrameCaptureFormat;
+
+extern FrameCapture* CreateFrameCapture(const char* prefix, FrameCaptureFormat format);
+
+/* Whether a staging surface is free for a snapshot, if not the snapshot is skipped and counted.
+ * Check it before paying for the read back.
+ */
+extern SDL_bool FrameCaptureHasRoom(FrameCapture* capture);
+
+/* Queue a snapshot read back with SDL_RenderReadPixels() before SDL_RenderPresent(), the capture
+ * takes ownership of the surface. NULL counts a failed read back as skipped. read_ticks is how
+ * long the read back took, in performance counter ticks.
+ */
+extern void CaptureFrameSurface(FrameCapture* capture,
+                                SDL_Surface* surface,
+                                int frame,
+                                Uint64 read_ticks);
+
+typedef struct MemoryReport MemoryReport;
+
+extern void AddFrameCaptureMemory(FrameCapture* capture, MemoryReport* report);
+extern void LogFrameCaptureStats(FrameCapture* capture);
+
+/* Finishes writing the snapshots that were already read back */
+extern void DestroyFrameCapture(FrameCapture* capture);
@@ -0,0 +1,275 @@
+/*
+  Copyright (C) 1997-2024 Sam Lantinga <slouken@libsdl.org>
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely.
+*/
+#include <SDL3/SDL.h>
+
+#ifdef SDL_PLATFORM_LINUX
+#include <dirent.h>
+#include <sched.h>
+#include <unistd.h>
+#endif
+#ifdef SDL_PLATFORM_WIN32
+#include <windows.h>
+#endif
+
+#include "testffmpeg_cpu.h"
+
+#define MAX_NUMA_NODES 64
+
+static CPUMask role_cpus[CPU_THREAD_ROLE_COUNT];
+static SDL_bool role_set[CPU_THREAD_ROLE_COUNT];
+
+/* The CPUs the process started on, threads go back to them when their role has no CPUs set */
+static CPUMask process_cpus;
+static SDL_bool process_cpus_set;
+
+static void AddCPU(CPUMask* mask, int cpu)
+{
+    mask->bits[cpu / 64] |= ((Uint64)1 << (cpu % 64));
+}
+
+static SDL_bool HasCPU(const CPUMask* mask, int cpu)
+{
+    return (mask->bits[cpu / 64] & ((Uint64)1 << (cpu % 64))) ? SDL_TRUE : SDL_FALSE;
+}
+
+SDL_bool ParseCPUList(const char* list, CPUMask* mask)
+{
+    const char* p = list;
+
+    SDL_zerop(mask);
+    while (*p) {
+        char* end;
+        long first = SDL_strtol(p, &end, 10);
+        long last = first;
+
+        if (end == p) {
+            return SDL_FALSE;
+        }
+        p = end;
+        if (*p == '-') {
+            ++p;
+            last = SDL_strtol(p, &end, 10);
+            if (end == p) {
+                return SDL_FALSE;
+            }
+            p = end;
+        }
+        if (first < 0 || last < first || last >= MAX_CPU_MASK_CPUS) {
+            return SDL_FALSE;
+        }
+        for (long cpu = first; cpu <= last; ++cpu) {
+            AddCPU(mask, (int)cpu);
+        }
+
+        if (*p == ',') {
+            ++p;
+        } else if (*p && *p != '\n') {
+            return SDL_FALSE;
+        } else {
+            break;
+        }
+    }
+    return SDL_TRUE;
+}
+
+SDL_bool GetCurrentThreadAffinity(CPUMask* mask)
+{
+#ifdef SDL_PLATFORM_LINUX
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) < 0) {
+        return SDL_FALSE;
+    }
+    SDL_zerop(mask);
+    for (int cpu = 0; cpu < MAX_CPU_MASK_CPUS && cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &set)) {
+            AddCPU(mask, cpu);
+        }
+    }
+    return SDL_TRUE;
+#elif defined(SDL_PLATFORM_WIN32)
+    /* There's no call to query a thread's mask, setting one returns the previous mask.
+     * Only the first processor group is supported.
+     */
+    DWORD_PTR process_mask, system_mask;
+    if (!GetProcessAffinityMask(GetCurrentProcess(), &process_mask, &system_mask)) {
+        return SDL_FALSE;
+    }
+    DWORD_PTR thread_mask = SetThreadAffinityMask(GetCurrentThread(), process_mask);
+    if (!thread_mask) {
+        return SDL_FALSE;
+    }
+    SetThreadAffinityMask(GetCurrentThread(), thread_mask);
+    SDL_zerop(mask);
+    mask->bits[0] = (Uint64)thread_mask;
+    return SDL_TRUE;
+#else
+    (void)mask;
+    return SDL_FALSE;
+#endif
+}
+
+SDL_bool SetCurrentThreadAffinity(const CPUMask* mask)
+{
+#if defined(SDL_PLATFORM_LINUX)
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    for (int cpu = 0; cpu < MAX_CPU_MASK_CPUS && cpu < CPU_SETSIZE; ++cpu) {
+        if (HasCPU(mask, cpu)) {
+            CPU_SET(cpu, &set);
+        }
+    }
+    if (sched_setaffinity(0, sizeof(set), &set) < 0) {
+        return SDL_FALSE;
+    }
+    return SDL_TRUE;
+#elif defined(SDL_PLATFORM_WIN32)
+    /* Only the first processor group is supported */
+    if (!SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)mask->bits[0])) {
+        return SDL_FALSE;
+    }
+    return SDL_TRUE;
+#else
+    (void)mask;
+    return SDL_FALSE;
+#endif
+}
+
+void SetThreadRoleCPUs(CPUThreadRole role, const CPUMask* mask)
+{
+    if (!process_cpus_set) {
+        /* Nothing has been pinned yet, so this is still the mask the process started with */
+        process_cpus_set = GetCurrentThreadAffinity(&process_cpus);
+    }
+    role_cpus[role] = *mask;
+    role_set[role] = SDL_TRUE;
+}
+
+SDL_bool UnpinCurrentThread(void)
+{
+    if (!process_cpus_set) {
+        return SDL_FALSE;
+    }
+    return SetCurrentThreadAffinity(&process_cpus);
+}
+
+SDL_bool PinCurrentThread(CPUThreadRole role)
+{
+    if (!role_set[role]) {
+        return UnpinCurrentThread();
+    }
+    return SetCurrentThreadAffinity(&role_cpus[role]);
+}
+
+Uint64 GetThreadRoleNodeMask(CPUThreadRole role)
+{
+    Uint64 nodes = 0;
+
+    if (!role_set[role]) {
+        return 0;
+    }
+
+#ifdef SDL_PLATFORM_LINUX
+    for (int node = 0; node < MAX_NUMA_NODES; ++node) {
+        char path[64];
+        char* list;
+        CPUMask node_cpus;
+
+        SDL_snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+        list = (char*)SDL_LoadFile(path, NULL);
+        if (!list) {
+            continue;
+        }
+        if (ParseCPUList(list, &node_cpus)) {
+            for (int i = 0; i < (int)SDL_arraysize(node_cpus.bits); ++i) {
+                if (node_cpus.bits[i] & role_cpus[role].bits[i]) {
+                    nodes |= ((Uint64)1 << node);
+                    break;
+                }
+            }
+        }
+        SDL_free(list);
+    }
+#endif
+    return nodes;
+}
+
+#ifdef SDL_PLATFORM_LINUX
+static SDL_bool GetThreadCPUTime(const char* tid, char* name, size_t maxlen, double* seconds)
+{
+    char path[64];
+    char* stat;
+    char* p;
+    Uint64 utime, stime;
+
+    SDL_snprintf(path, sizeof(path), "/proc/self/task/%s/stat", tid);
+    stat = (char*)SDL_LoadFile(path, NULL);
+    if (!stat) {
+        return SDL_FALSE;
+    }
+
+    /* The thread name is in parentheses and may itself contain spaces or parentheses */
+    char* open = SDL_strchr(stat, '(');
+    char* close = SDL_strrchr(stat, ')');
+    if (!open || !close || close < open) {
+        SDL_free(stat);
+        return SDL_FALSE;
+    }
+    *close = '\0';
+    SDL_strlcpy(name, open + 1, maxlen);
+
+    /* utime and stime are fields 14 and 15, the field after the name is 3 */
+    p = close + 1;
+    for (int field = 3; field < 14 && p; ++field) {
+        p = SDL_strchr(p + 1, ' ');
+    }
+    if (!p) {
+        SDL_free(stat);
+        return SDL_FALSE;
+    }
+    utime = SDL_strtoull(p, &p, 10);
+    stime = SDL_strtoull(p, &p, 10);
+    SDL_free(stat);
+
+    *seconds = (double)(utime + stime) / sysconf(_SC_CLK_TCK);
+    return SDL_TRUE;
+}
+#endif
+
+void LogThreadCPUTimes(void)
+{
+#ifdef SDL_PLATFORM_LINUX
+    DIR* dir = opendir("/proc/self/task");
+    struct dirent* entry;
+
+    if (!dir) {
+        return;
+    }
+
+    /* Threads that have already exited, like those of closed decoders, aren't included */
+    SDL_Log("Thread CPU time:\n");
+    while ((entry = readdir(dir)) != NULL) {
+        char name[32];
+        double seconds;
+
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        if (GetThreadCPUTime(entry->d_name, name, sizeof(name), &seconds)) {
+            SDL_Log("    %-16s %8.3f s\n", name, seconds);
+        }
+    }
+    closedir(dir);
+#endif
+}
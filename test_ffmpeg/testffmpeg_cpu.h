@@ -0,0 +1,52 @@
+/*
+  Copyright (C) 1997-2024 Sam Lantinga <slouken@libsdl.org>
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely.
+*/
+
+#define MAX_CPU_MASK_CPUS 256
+
+typedef struct CPUMask
+{
+    Uint64 bits[MAX_CPU_MASK_CPUS / 64];
+} CPUMask;
+
+/* The groups of pipeline threads that can be pinned to their own CPUs */
+typedef enum CPUThreadRole
+{
+    CPU_THREAD_RENDER,
+    CPU_THREAD_AUDIO,
+    CPU_THREAD_DECODE,
+    CPU_THREAD_ROLE_COUNT
+} CPUThreadRole;
+
+/* Parse a CPU list like "0-3,8,10-11" */
+extern SDL_bool ParseCPUList(const char* list, CPUMask* mask);
+
+/* Implemented for Linux, and for the first processor group on Windows */
+extern SDL_bool GetCurrentThreadAffinity(CPUMask* mask);
+extern SDL_bool SetCurrentThreadAffinity(const CPUMask* mask);
+
+/* Set the CPUs for a role, threads pick it up when they call PinCurrentThread() */
+extern void SetThreadRoleCPUs(CPUThreadRole role, const CPUMask* mask);
+
+/* New threads inherit the mask of the thread that created them, so when another role has CPUs
+ * set, a role without any goes back to the CPUs the process started with rather than sharing
+ * the creator's. Returns SDL_FALSE if no role has CPUs set or the thread couldn't be pinned.
+ */
+extern SDL_bool PinCurrentThread(CPUThreadRole role);
+
+/* Go back to the CPUs the process started with, for helper threads started by a pinned thread */
+extern SDL_bool UnpinCurrentThread(void);
+
+/* The NUMA nodes that a role's CPUs belong to, one bit per node, or 0 if unknown */
+extern Uint64 GetThreadRoleNodeMask(CPUThreadRole role);
+
+/* Log the CPU time used by each live thread in the process */
+extern void LogThreadCPUTimes(void);
@@ -0,0 +1,440 @@
+/*
+  Copyright (C) 1997-2024 Sam Lantinga <slouken@libsdl.org>
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely.
+*/
+#include <SDL3/SDL.h>
+
+extern "C" {
+#include <libavfilter/avfilter.h>
+#include <libavfilter/buffersink.h>
+#include <libavfilter/buffersrc.h>
+#include <libavutil/hwcontext.h>
+#include <libavutil/pixdesc.h>
+}
+
+#include "testffmpeg_cpu.h"
+#include "testffmpeg_filter.h"
+#include "testffmpeg_memory.h"
+#include "testffmpeg_trace.h"
+
+typedef struct VideoFrameQueue
+{
+    AVFrame* frames[VIDEO_FILTER_QUEUE_SIZE];
+    int head;
+    int count;
+} VideoFrameQueue;
+
+struct VideoFilter
+{
+    char* description;
+    AVRational time_base;
+    SDL_Thread* thread;
+
+    /* Protected by lock */
+    SDL_Mutex* lock;
+    SDL_Condition* input_ready;
+    SDL_Condition* output_ready;
+    VideoFrameQueue input;
+    VideoFrameQueue output;
+    SDL_bool input_finished;  /* the end of the stream was sent */
+    SDL_bool output_finished; /* the filter thread is done */
+    SDL_bool quit;
+    int frames;
+    Uint64 ticks;
+
+    /* Only used by the filter thread */
+    AVFrame* frame;
+    AVFrame* scratch;
+    AVFilterGraph* graph;
+    AVFilterContext* src;
+    AVFilterContext* sink;
+    SDL_bool failed;
+};
+
+static SDL_bool InitVideoFrameQueue(VideoFrameQueue* queue)
+{
+    for (int i = 0; i < VIDEO_FILTER_QUEUE_SIZE; ++i) {
+        queue->frames[i] = av_frame_alloc();
+        if (!queue->frames[i]) {
+            return SDL_FALSE;
+        }
+    }
+    return SDL_TRUE;
+}
+
+static void FreeVideoFrameQueue(VideoFrameQueue* queue)
+{
+    for (int i = 0; i < VIDEO_FILTER_QUEUE_SIZE; ++i) {
+        av_frame_free(&queue->frames[i]);
+    }
+}
+
+static void PushVideoFrame(VideoFrameQueue* queue, AVFrame* frame)
+{
+    int tail = (queue->head + queue->count) % VIDEO_FILTER_QUEUE_SIZE;
+    av_frame_move_ref(queue->frames[tail], frame);
+    ++queue->count;
+}
+
+static void PopVideoFrame(VideoFrameQueue* queue, AVFrame* frame)
+{
+    av_frame_move_ref(frame, queue->frames[queue->head]);
+    queue->head = (queue->head + 1) % VIDEO_FILTER_QUEUE_SIZE;
+    --queue->count;
+}
+
+SDL_bool ConfigureFilterGraph(AVFilterGraph* graph,
+                              AVFilterContext* src,
+                              AVFilterContext* sink,
+                              const char* description)
+{
+    AVFilterInOut* outputs = avfilter_inout_alloc();
+    AVFilterInOut* inputs = avfilter_inout_alloc();
+    int result;
+
+    if (!outputs || !inputs) {
+        avfilter_inout_free(&outputs);
+        avfilter_inout_free(&inputs);
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "avfilter_inout_alloc failed");
+        return SDL_FALSE;
+    }
+    outputs->name = av_strdup("in");
+    outputs->filter_ctx = src;
+    outputs->pad_idx = 0;
+    outputs->next = NULL;
+    inputs->name = av_strdup("out");
+    inputs->filter_ctx = sink;
+    inputs->pad_idx = 0;
+    inputs->next = NULL;
+
+    result = avfilter_graph_parse_ptr(graph, description, &inputs, &outputs, NULL);
+    avfilter_inout_free(&outputs);
+    avfilter_inout_free(&inputs);
+    if (result < 0) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Couldn't parse filter '%s': %d", description,
+                     result);
+        return SDL_FALSE;
+    }
+    result = avfilter_graph_config(graph, NULL);
+    if (result < 0) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Couldn't configure filter '%s': %d",
+                     description, result);
+        return SDL_FALSE;
+    }
+    return SDL_TRUE;
+}
+
+static SDL_bool CreateVideoFilterGraph(VideoFilter* filter, const AVFrame* frame)
+{
+    char args[256];
+    int result;
+
+    filter->graph = avfilter_graph_alloc();
+    if (!filter->graph) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "avfilter_graph_alloc failed");
+        return SDL_FALSE;
+    }
+    /* Let the filters split frames into slices across as many threads as there are CPUs */
+    filter->graph->thread_type = AVFILTER_THREAD_SLICE;
+    filter->graph->nb_threads = 0;
+
+    SDL_snprintf(args, sizeof(args),
+                 "video_size=%dx%d:pix_fmt=%d:time_base=%d/%d:pixel_aspect=%d/%d", frame->width,
+                 frame->height, frame->format, filter->time_base.num, filter->time_base.den,
+                 frame->sample_aspect_ratio.num, SDL_max(frame->sample_aspect_ratio.den, 1));
+    result = avfilter_graph_create_filter(&filter->src, avfilter_get_by_name("buffer"), "in",
+                                          args, NULL, filter->graph);
+    if (result < 0) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Couldn't create buffer filter: %d", result);
+        return SDL_FALSE;
+    }
+    result = avfilter_graph_create_filter(&filter->sink, avfilter_get_by_name("buffersink"),
+                                          "out", NULL, NULL, filter->graph);
+    if (result < 0) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Couldn't create buffersink filter: %d",
+                     result);
+        return SDL_FALSE;
+    }
+
+    if (!ConfigureFilterGraph(filter->graph, filter->src, filter->sink, filter->description)) {
+        return SDL_FALSE;
+    }
+
+    SDL_Log("Video filter '%s': %dx%d %s -> %dx%d %s\n", filter->description, frame->width,
+            frame->height, av_get_pix_fmt_name((enum AVPixelFormat)frame->format),
+            av_buffersink_get_w(filter->sink), av_buffersink_get_h(filter->sink),
+            av_get_pix_fmt_name((enum AVPixelFormat)av_buffersink_get_format(filter->sink)));
+    return SDL_TRUE;
+}
+
+/* Software filters can't read hardware frames, so copy them to memory first */
+static SDL_bool DownloadVideoFrame(AVFrame* frame, AVFrame* scratch)
+{
+    if (!frame->hw_frames_ctx) {
+        return SDL_TRUE;
+    }
+
+    int result = av_hwframe_transfer_data(scratch, frame, 0);
+    if (result < 0) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "av_hwframe_transfer_data failed: %d", result);
+        return SDL_FALSE;
+    }
+    av_frame_copy_props(scratch, frame);
+    av_frame_unref(frame);
+    av_frame_move_ref(frame, scratch);
+    return SDL_TRUE;
+}
+
+/* Hand a frame to the renderer, waiting for it to make room */
+static void QueueFilteredFrame(VideoFilter* filter, AVFrame* frame, Uint64 start)
+{
+    EndTraceEvent("filter", GetFrameTraceID(frame), start);
+
+    SDL_LockMutex(filter->lock);
+    filter->ticks += SDL_GetPerformanceCounter() - start;
+    ++filter->frames;
+    while (filter->output.count == VIDEO_FILTER_QUEUE_SIZE && !filter->quit) {
+        SDL_WaitCondition(filter->input_ready, filter->lock);
+    }
+    if (filter->quit) {
+        av_frame_unref(frame);
+    } else {
+        PushVideoFrame(&filter->output, frame);
+        SDL_BroadcastCondition(filter->output_ready);
+    }
+    SDL_UnlockMutex(filter->lock);
+}
+
+static void DrainVideoFilterGraph(VideoFilter* filter, Uint64 start)
+{
+    AVRational sink_time_base = av_buffersink_get_time_base(filter->sink);
+    AVFrame* frame = filter->frame;
+
+    while (av_buffersink_get_frame(filter->sink, frame) >= 0) {
+        if (frame->pts != AV_NOPTS_VALUE) {
+            frame->pts = av_rescale_q(frame->pts, sink_time_base, filter->time_base);
+        }
+        QueueFilteredFrame(filter, frame, start);
+        start = SDL_GetPerformanceCounter();
+    }
+}
+
+static int SDLCALL VideoFilterThread(void* data)
+{
+    VideoFilter* filter = (VideoFilter*)data;
+    AVFrame* frame = filter->frame;
+
+    /* Filtering is part of decoding, and the filter's slice threads inherit this affinity */
+    PinCurrentThread(CPU_THREAD_DECODE);
+    SetTraceThreadName("video_filter");
+
+    for (;;) {
+        SDL_bool finished = SDL_FALSE;
+
+        SDL_LockMutex(filter->lock);
+        while (filter->input.count == 0 && !filter->input_finished && !filter->quit) {
+            SDL_WaitCondition(filter->input_ready, filter->lock);
+        }
+        if (filter->quit) {
+            SDL_UnlockMutex(filter->lock);
+            break;
+        }
+        if (filter->input.count > 0) {
+            PopVideoFrame(&filter->input, frame);
+            /* There's room for the decoder again */
+            SDL_BroadcastCondition(filter->output_ready);
+        } else {
+            finished = SDL_TRUE;
+        }
+        SDL_UnlockMutex(filter->lock);
+
+        Uint64 start = SDL_GetPerformanceCounter();
+        if (finished) {
+            if (filter->graph && !filter->failed &&
+                av_buffersrc_add_frame_flags(filter->src, NULL, 0) >= 0) {
+                DrainVideoFilterGraph(filter, start);
+            }
+            break;
+        }
+        if (!filter->failed && !filter->graph &&
+            (!DownloadVideoFrame(frame, filter->scratch) ||
+             !CreateVideoFilterGraph(filter, frame))) {
+            SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Showing video without filter '%s'",
+                        filter->description);
+            filter->failed = SDL_TRUE;
+        }
+        if (filter->failed) {
+            /* Pass frames through, so the video still plays */
+            QueueFilteredFrame(filter, frame, start);
+            continue;
+        }
+        if (!DownloadVideoFrame(frame, filter->scratch)) {
+            av_frame_unref(frame);
+            continue;
+        }
+        int result = av_buffersrc_add_frame_flags(filter->src, frame, 0);
+        if (result < 0) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "av_buffersrc_add_frame failed: %d",
+                         result);
+            av_frame_unref(frame);
+            continue;
+        }
+        DrainVideoFilterGraph(filter, start);
+    }
+
+    SDL_LockMutex(filter->lock);
+    filter->output_finished = SDL_TRUE;
+    SDL_BroadcastCondition(filter->output_ready);
+    SDL_UnlockMutex(filter->lock);
+    return 0;
+}
+
+VideoFilter* CreateVideoFilter(const char* description, AVRational time_base)
+{
+    VideoFilter* filter = static_cast<VideoFilter*>(SDL_calloc(1, sizeof(*filter)));
+    if (!filter) {
+        return NULL;
+    }
+    filter->description = SDL_strdup(description);
+    filter->time_base = time_base;
+    filter->lock = SDL_CreateMutex();
+    filter->input_ready = SDL_CreateCondition();
+    filter->output_ready = SDL_CreateCondition();
+    filter->frame = av_frame_alloc();
+    filter->scratch = av_frame_alloc();
+    if (!filter->description || !filter->lock || !filter->input_ready || !filter->output_ready ||
+        !filter->frame || !filter->scratch || !InitVideoFrameQueue(&filter->input) ||
+        !InitVideoFrameQueue(&filter->output)) {
+        DestroyVideoFilter(filter);
+        return NULL;
+    }
+
+    filter->thread = SDL_CreateThread(VideoFilterThread, "video_filter", filter);
+    if (!filter->thread) {
+        DestroyVideoFilter(filter);
+        return NULL;
+    }
+    return filter;
+}
+
+SDL_bool SendVideoFilterFrame(VideoFilter* filter, AVFrame* frame)
+{
+    SDL_bool sent = SDL_TRUE;
+
+    SDL_LockMutex(filter->lock);
+    if (!frame) {
+        filter->input_finished = SDL_TRUE;
+    } else if (filter->input_finished) {
+        /* Nothing more is accepted after the end of the stream */
+        av_frame_unref(frame);
+    } else {
+        while (filter->input.count == VIDEO_FILTER_QUEUE_SIZE && filter->output.count == 0 &&
+               !filter->output_finished) {
+            SDL_WaitCondition(filter->output_ready, filter->lock);
+        }
+        if (filter->input.count < VIDEO_FILTER_QUEUE_SIZE) {
+            PushVideoFrame(&filter->input, frame);
+        } else if (filter->output_finished) {
+            av_frame_unref(frame);
+        } else {
+            sent = SDL_FALSE;
+        }
+    }
+    SDL_BroadcastCondition(filter->input_ready);
+    SDL_UnlockMutex(filter->lock);
+    return sent;
+}
+
+SDL_bool ReceiveVideoFilterFrame(VideoFilter* filter, AVFrame* frame, int timeout_ms)
+{
+    SDL_bool received = SDL_FALSE;
+
+    SDL_LockMutex(filter->lock);
+    if (filter->output.count == 0 && !filter->output_finished && timeout_ms > 0) {
+        SDL_WaitConditionTimeout(filter->output_ready, filter->lock, timeout_ms);
+    }
+    if (filter->output.count > 0) {
+        PopVideoFrame(&filter->output, frame);
+        /* There's room for the filter thread again */
+        SDL_BroadcastCondition(filter->input_ready);
+        received = SDL_TRUE;
+    }
+    SDL_UnlockMutex(filter->lock);
+    return received;
+}
+
+SDL_bool VideoFilterFinished(VideoFilter* filter)
+{
+    SDL_bool finished;
+
+    SDL_LockMutex(filter->lock);
+    finished = (filter->output_finished && filter->output.count == 0) ? SDL_TRUE : SDL_FALSE;
+    SDL_UnlockMutex(filter->lock);
+    return finished;
+}
+
+void GetVideoFilterStats(VideoFilter* filter, int* frames, double* ms)
+{
+    SDL_LockMutex(filter->lock);
+    *frames = filter->frames;
+    *ms = (double)filter->ticks * 1000.0 / SDL_GetPerformanceFrequency();
+    SDL_UnlockMutex(filter->lock);
+}
+
+static void AddVideoFrameQueueMemory(VideoFrameQueue* queue, MemoryReport* report)
+{
+    for (int i = 0; i < queue->count; ++i) {
+        AVFrame* frame = queue->frames[(queue->head + i) % VIDEO_FILTER_QUEUE_SIZE];
+        AddMemory(report, MEMORY_FRAMES, GetFrameMemory(frame));
+    }
+}
+
+void AddVideoFilterMemory(VideoFilter* filter, MemoryReport* report)
+{
+    if (!filter) {
+        return;
+    }
+
+    SDL_LockMutex(filter->lock);
+    AddVideoFrameQueueMemory(&filter->input, report);
+    AddVideoFrameQueueMemory(&filter->output, report);
+    SDL_UnlockMutex(filter->lock);
+}
+
+void DestroyVideoFilter(VideoFilter* filter)
+{
+    if (!filter) {
+        return;
+    }
+
+    if (filter->thread) {
+        SDL_LockMutex(filter->lock);
+        filter->quit = SDL_TRUE;
+        SDL_BroadcastCondition(filter->input_ready);
+        SDL_UnlockMutex(filter->lock);
+        SDL_WaitThread(filter->thread, NULL);
+    }
+    avfilter_graph_free(&filter->graph);
+    av_frame_free(&filter->scratch);
+    av_frame_free(&filter->frame);
+    FreeVideoFrameQueue(&filter->input);
+    FreeVideoFrameQueue(&filter->output);
+    if (filter->output_ready) {
+        SDL_DestroyCondition(filter->output_ready);
+    }
+    if (filter->input_ready) {
+        SDL_DestroyCondition(filter->input_ready);
+    }
+    if (filter->lock) {
+        SDL_DestroyMutex(filter->lock);
+    }
+    SDL_free(filter->description);
+    SDL_free(filter);
+}
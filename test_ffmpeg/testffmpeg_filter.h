@@ -0,0 +1,57 @@
+/*
+  Copyright (C) 1997-2024 Sam Lantinga <slouken@libsdl.org>
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely.
+*/
+
+extern "C" {
+#include <libavfilter/avfilter.h>
+#include <libavutil/frame.h>
+#include <libavutil/rational.h>
+}
+
+/* A libavfilter graph, e.g. "bwdif,scale=1280:-2", run on its own thread between the video
+ * decoder and the renderer. Hardware frames are downloaded on that thread before filtering.
+ */
+typedef struct VideoFilter VideoFilter;
+
+/* Decoded frames waiting to be filtered, and filtered frames waiting to be shown */
+#define VIDEO_FILTER_QUEUE_SIZE 4
+
+/* Frame timestamps are in time_base on the way in and out */
+extern VideoFilter* CreateVideoFilter(const char* description, AVRational time_base);
+
+/* Take the frame, or NULL at the end of the stream. Returns SDL_FALSE without taking it if
+ * the filter is backed up, receive some frames and try again.
+ */
+extern SDL_bool SendVideoFilterFrame(VideoFilter* filter, AVFrame* frame);
+
+/* Wait up to timeout_ms for a filtered frame */
+extern SDL_bool ReceiveVideoFilterFrame(VideoFilter* filter, AVFrame* frame, int timeout_ms);
+
+/* The end of the stream was sent and every filtered frame has been received */
+extern SDL_bool VideoFilterFinished(VideoFilter* filter);
+
+/* The number of frames that came out of the filter, and the time spent producing them */
+extern void GetVideoFilterStats(VideoFilter* filter, int* frames, double* ms);
+
+typedef struct MemoryReport MemoryReport;
+
+/* Count the frames waiting in the filter queues */
+extern void AddVideoFilterMemory(VideoFilter* filter, MemoryReport* report);
+
+extern void DestroyVideoFilter(VideoFilter* filter);
+
+/* Connect the "in" source and "out" sink of a graph through the filters in description, and
+ * configure it. Errors are logged.
+ */
+extern SDL_bool ConfigureFilterGraph(AVFilterGraph* graph,
+                                     AVFilterContext* src,
+                                     AVFilterContext* sink,
+                                     const char* description);
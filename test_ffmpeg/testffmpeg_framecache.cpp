@@ -0,0 +1,282 @@
+/*
+  Copyright (C) 1997-2024 Sam Lantinga <slouken@libsdl.org>
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely.
+*/
+#include <SDL3/SDL.h>
+
+extern "C" {
+#include <libavutil/hwcontext.h>
+}
+
+#include "testffmpeg_framecache.h"
+#include "testffmpeg_memory.h"
+
+typedef struct CachedFrame
+{
+    AVFrame* frame;
+    SDL_Texture* texture;
+    Sint64 prev_pts;
+
+    /* In order of use, most recent first */
+    struct CachedFrame* prev;
+    struct CachedFrame* next;
+} CachedFrame;
+
+struct FrameCache
+{
+    Uint64 budget;
+    CachedFrame* head;
+    CachedFrame* tail;
+    int count;
+
+    int hits;
+    int misses;
+    int evicted;
+};
+
+FrameCache* CreateFrameCache(Uint64 budget_bytes)
+{
+    FrameCache* cache = static_cast<FrameCache*>(SDL_calloc(1, sizeof(*cache)));
+    if (!cache) {
+        return NULL;
+    }
+    cache->budget = budget_bytes;
+    return cache;
+}
+
+static void UnlinkCachedFrame(FrameCache* cache, CachedFrame* entry)
+{
+    if (entry->prev) {
+        entry->prev->next = entry->next;
+    } else {
+        cache->head = entry->next;
+    }
+    if (entry->next) {
+        entry->next->prev = entry->prev;
+    } else {
+        cache->tail = entry->prev;
+    }
+    entry->prev = entry->next = NULL;
+}
+
+static void UseCachedFrame(FrameCache* cache, CachedFrame* entry)
+{
+    if (cache->head == entry) {
+        return;
+    }
+    if (entry->prev || entry->next || cache->tail == entry) {
+        UnlinkCachedFrame(cache, entry);
+    }
+    entry->next = cache->head;
+    if (cache->head) {
+        cache->head->prev = entry;
+    } else {
+        cache->tail = entry;
+    }
+    cache->head = entry;
+}
+
+static void FreeCachedFrame(CachedFrame* entry)
+{
+    if (entry->texture) {
+        SDL_DestroyTexture(entry->texture);
+    }
+    av_frame_free(&entry->frame);
+    SDL_free(entry);
+}
+
+static CachedFrame* FindCachedFrame(FrameCache* cache, Sint64 pts)
+{
+    if (!cache || pts == AV_NOPTS_VALUE) {
+        return NULL;
+    }
+    for (CachedFrame* entry = cache->head; entry; entry = entry->next) {
+        if (entry->frame->pts == pts) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static Uint64 GetCachedFrameMemory(const CachedFrame* entry)
+{
+    return GetFrameMemory(entry->frame) + GetTextureMemory(entry->texture);
+}
+
+void TrimFrameCache(FrameCache* cache)
+{
+    Uint64 bytes = 0;
+    int kept = 0;
+
+    if (!cache) {
+        return;
+    }
+    for (CachedFrame* entry = cache->head; entry;) {
+        CachedFrame* next = entry->next;
+
+        bytes += GetCachedFrameMemory(entry);
+        if (++kept > MIN_CACHED_FRAMES && bytes > cache->budget) {
+            UnlinkCachedFrame(cache, entry);
+            FreeCachedFrame(entry);
+            --cache->count;
+            ++cache->evicted;
+        }
+        entry = next;
+    }
+}
+
+SDL_bool AddCachedFrame(FrameCache* cache, const AVFrame* frame, Sint64 prev_pts)
+{
+    if (!cache || frame->pts == AV_NOPTS_VALUE) {
+        return SDL_FALSE;
+    }
+
+    CachedFrame* entry = FindCachedFrame(cache, frame->pts);
+    if (entry) {
+        /* Decoded again, after a seek back, this may know what came before it now */
+        if (entry->prev_pts == AV_NOPTS_VALUE) {
+            entry->prev_pts = prev_pts;
+        }
+        UseCachedFrame(cache, entry);
+        return SDL_TRUE;
+    }
+
+    entry = static_cast<CachedFrame*>(SDL_calloc(1, sizeof(*entry)));
+    if (!entry) {
+        return SDL_FALSE;
+    }
+    entry->frame = av_frame_alloc();
+    if (!entry->frame) {
+        SDL_free(entry);
+        return SDL_FALSE;
+    }
+
+    int result;
+    if (frame->hw_frames_ctx) {
+        /* Holding on to hardware frames would starve the decoder's surface pool */
+        result = av_hwframe_transfer_data(entry->frame, frame, 0);
+        if (result >= 0) {
+            result = av_frame_copy_props(entry->frame, frame);
+        }
+    } else {
+        result = av_frame_ref(entry->frame, frame);
+    }
+    if (result < 0) {
+        FreeCachedFrame(entry);
+        return SDL_FALSE;
+    }
+    entry->prev_pts = prev_pts;
+
+    UseCachedFrame(cache, entry);
+    ++cache->count;
+    TrimFrameCache(cache);
+    return SDL_TRUE;
+}
+
+AVFrame* GetCachedFrame(FrameCache* cache, Sint64 pts)
+{
+    CachedFrame* entry = FindCachedFrame(cache, pts);
+    if (!entry) {
+        return NULL;
+    }
+    UseCachedFrame(cache, entry);
+    return entry->frame;
+}
+
+AVFrame* GetNextCachedFrame(FrameCache* cache, Sint64 pts)
+{
+    if (!cache || pts == AV_NOPTS_VALUE) {
+        return NULL;
+    }
+    for (CachedFrame* entry = cache->head; entry; entry = entry->next) {
+        if (entry->prev_pts == pts) {
+            ++cache->hits;
+            UseCachedFrame(cache, entry);
+            return entry->frame;
+        }
+    }
+    ++cache->misses;
+    return NULL;
+}
+
+AVFrame* GetPreviousCachedFrame(FrameCache* cache, Sint64 pts)
+{
+    CachedFrame* entry = FindCachedFrame(cache, pts);
+    CachedFrame* previous = entry ? FindCachedFrame(cache, entry->prev_pts) : NULL;
+
+    if (!cache) {
+        return NULL;
+    }
+    if (!previous) {
+        ++cache->misses;
+        return NULL;
+    }
+    ++cache->hits;
+    UseCachedFrame(cache, previous);
+    return previous->frame;
+}
+
+SDL_Texture** GetCachedFrameTexture(FrameCache* cache, const AVFrame* frame)
+{
+    CachedFrame* entry = FindCachedFrame(cache, frame->pts);
+    if (!entry || entry->frame != frame) {
+        return NULL;
+    }
+    return &entry->texture;
+}
+
+void ClearFrameCache(FrameCache* cache)
+{
+    if (!cache) {
+        return;
+    }
+    while (cache->head) {
+        CachedFrame* entry = cache->head;
+        UnlinkCachedFrame(cache, entry);
+        FreeCachedFrame(entry);
+    }
+    cache->count = 0;
+}
+
+void AddFrameCacheMemory(FrameCache* cache, MemoryReport* report)
+{
+    if (!cache) {
+        return;
+    }
+    for (CachedFrame* entry = cache->head; entry; entry = entry->next) {
+        AddMemory(report, MEMORY_FRAMES, GetFrameMemory(entry->frame));
+        if (entry->texture) {
+            AddMemory(report, MEMORY_TEXTURES, GetTextureMemory(entry->texture));
+        }
+    }
+}
+
+void LogFrameCacheStats(FrameCache* cache)
+{
+    Uint64 bytes = 0;
+
+    if (!cache || cache->hits + cache->misses == 0) {
+        return;
+    }
+    for (CachedFrame* entry = cache->head; entry; entry = entry->next) {
+        bytes += GetCachedFrameMemory(entry);
+    }
+    SDL_Log("Frame cache: %d hits, %d misses, %d evicted, %d frames in %.1f MB\n", cache->hits,
+            cache->misses, cache->evicted, cache->count, bytes / (1024.0 * 1024.0));
+}
+
+void DestroyFrameCache(FrameCache* cache)
+{
+    if (!cache) {
+        return;
+    }
+    ClearFrameCache(cache);
+    SDL_free(cache);
+}
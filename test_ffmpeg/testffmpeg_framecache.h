@@ -0,0 +1,56 @@
+/*
+  Copyright (C) 1997-2024 Sam Lantinga <slouken@libsdl.org>
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely.
+*/
+
+extern "C" {
+#include <libavutil/frame.h>
+}
+
+/* Recently decoded video frames, and the textures they were uploaded to while stepping,
+ * kept within a memory budget by evicting the least recently used. Frames are found by pts,
+ * and each one remembers the pts of the frame decoded just before it, so stepping can tell
+ * whether a neighbour is cached or has to be decoded again.
+ */
+typedef struct FrameCache FrameCache;
+
+/* The budget when --frame-cache isn't given, frames are then only cached while paused */
+#define DEFAULT_FRAME_CACHE_MB 256
+
+/* The most recently used frames are kept even over budget, so a step back always has the
+ * frame it decoded and the one it came from
+ */
+#define MIN_CACHED_FRAMES 2
+
+extern FrameCache* CreateFrameCache(Uint64 budget_bytes);
+
+/* Keep a reference to the frame, hardware frames are copied to system memory first.
+ * prev_pts is the pts of the frame decoded before it, or AV_NOPTS_VALUE after a seek.
+ */
+extern SDL_bool AddCachedFrame(FrameCache* cache, const AVFrame* frame, Sint64 prev_pts);
+
+/* These return frames owned by the cache, and mark them as recently used */
+extern AVFrame* GetCachedFrame(FrameCache* cache, Sint64 pts);
+extern AVFrame* GetNextCachedFrame(FrameCache* cache, Sint64 pts);
+extern AVFrame* GetPreviousCachedFrame(FrameCache* cache, Sint64 pts);
+
+/* Where the texture for a cached frame is kept, it's counted against the budget */
+extern SDL_Texture** GetCachedFrameTexture(FrameCache* cache, const AVFrame* frame);
+
+/* Evict frames until the cache is within budget again, after textures have been created */
+extern void TrimFrameCache(FrameCache* cache);
+
+extern void ClearFrameCache(FrameCache* cache);
+
+typedef struct MemoryReport MemoryReport;
+
+extern void AddFrameCacheMemory(FrameCache* cache, MemoryReport* report);
+extern void LogFrameCacheStats(FrameCache* cache);
+extern void DestroyFrameCache(FrameCache* cache);
@@ -0,0 +1,516 @@
+/*
+  Copyright (C) 1997-2024 Sam Lantinga <slouken@libsdl.org>
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely.
+*/
+/* Generates the clips played by the benchmark suite, so no media has to be checked in.
+ *
+ * The video is a moving pattern with some noise, so it isn't trivial to decode, and the
+ * optional audio is a different tone on each channel, encoded as planar float AAC.
+ *
+ * With --live it's paced in real time and stamps each frame with a timestamp pattern, to be
+ * streamed to testffmpeg --low-latency, e.g. as mpegts to a local UDP port.
+ */
+#include <SDL3/SDL.h>
+
+#include <stdio.h>
+#include <string>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/channel_layout.h>
+#include <libavutil/dict.h>
+#include <libavutil/mathematics.h>
+#include <libavutil/pixdesc.h>
+#include <libavutil/time.h>
+#include <libswscale/swscale.h>
+}
+
+#include "testffmpeg_timestamp.h"
+
+std::string make_ffmpeg_error_string(int error)
+{
+    std::string error_string;
+    error_string.resize(AV_ERROR_MAX_STRING_SIZE);
+    av_strerror(error, error_string.data(), error_string.size());
+    return error_string;
+}
+
+#undef av_err2str
+#define av_err2str(errnum) make_ffmpeg_error_string(errnum).c_str()
+
+/* The exit code when this FFmpeg build can't encode the requested clip, CTest skips on it */
+#define GENMEDIA_UNSUPPORTED 77
+
+#define GENMEDIA_FRAME_RATE 30
+
+typedef struct EncoderChoice
+{
+    const char* codec;
+    const char* encoder;
+    const char* options;
+    const char* live_options; /* added for --live, so frames come out as they go in */
+} EncoderChoice;
+
+/* The fastest settings of each encoder, the clips only need to exist */
+static const EncoderChoice encoder_choices[] = {
+    {"h264", "libx264", "preset=ultrafast", "tune=zerolatency"},
+    {"hevc", "libx265", "preset=ultrafast", "tune=zerolatency"},
+    {"vp9", "libvpx-vp9", "deadline=realtime,cpu-used=8,row-mt=1", "lag-in-frames=0"},
+    {"av1", "libsvtav1", "preset=12", "svtav1-params=pred-struct=1"},
+    {"av1", "libaom-av1", "usage=realtime,cpu-used=10,row-mt=1", "lag-in-frames=0"},
+    {"av1", "librav1e", "speed=10", "rav1e-params=low_latency=true"},
+};
+
+typedef struct OutputStream
+{
+    AVStream* stream;
+    AVCodecContext* context;
+    AVFrame* frame;
+    AVPacket* pkt;
+    Sint64 next_pts;
+} OutputStream;
+
+static SDL_bool EncoderSupportsPixelFormat(const AVCodec* codec, enum AVPixelFormat pix_fmt)
+{
+    if (!codec->pix_fmts) {
+        /* No list, so we'll find out when it's opened */
+        return SDL_TRUE;
+    }
+    for (int i = 0; codec->pix_fmts[i] != AV_PIX_FMT_NONE; ++i) {
+        if (codec->pix_fmts[i] == pix_fmt) {
+            return SDL_TRUE;
+        }
+    }
+    return SDL_FALSE;
+}
+
+/* live_options is NULL unless the output is --live */
+static AVCodecContext* OpenEncoder(const AVCodec* codec,
+                                   const char* options,
+                                   const char* live_options,
+                                   AVFormatContext* oc,
+                                   enum AVPixelFormat pix_fmt,
+                                   int width,
+                                   int height)
+{
+    AVCodecContext* context = avcodec_alloc_context3(codec);
+    AVDictionary* dict = NULL;
+
+    if (!context) {
+        return NULL;
+    }
+    context->width = width;
+    context->height = height;
+    context->pix_fmt = pix_fmt;
+    context->time_base = AVRational{1, GENMEDIA_FRAME_RATE};
+    context->framerate = AVRational{GENMEDIA_FRAME_RATE, 1};
+    context->gop_size = GENMEDIA_FRAME_RATE * 2;
+    context->bit_rate = (Sint64)width * height * 4;
+    if (oc->oformat->flags & AVFMT_GLOBALHEADER) {
+        context->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    }
+
+    av_dict_parse_string(&dict, options, "=", ",", 0);
+    if (live_options) {
+        /* Frames go out in order, and a player joining late waits at most a second */
+        context->max_b_frames = 0;
+        context->gop_size = GENMEDIA_FRAME_RATE;
+        av_dict_parse_string(&dict, live_options, "=", ",", 0);
+    }
+    int result = avcodec_open2(context, codec, &dict);
+    av_dict_free(&dict);
+    if (result < 0) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Couldn't open encoder %s: %s", codec->name,
+                    av_err2str(result));
+        avcodec_free_context(&context);
+        return NULL;
+    }
+    return context;
+}
+
+/* Returns 0 on success, GENMEDIA_UNSUPPORTED if there's no usable encoder */
+static int OpenVideoOutput(AVFormatContext* oc,
+                           OutputStream* ost,
+                           const char* codec_name,
+                           enum AVPixelFormat pix_fmt,
+                           int width,
+                           int height,
+                           SDL_bool live)
+{
+    for (int i = 0; i < (int)SDL_arraysize(encoder_choices) && !ost->context; ++i) {
+        const EncoderChoice* choice = &encoder_choices[i];
+        if (SDL_strcmp(choice->codec, codec_name) != 0) {
+            continue;
+        }
+        const AVCodec* codec = avcodec_find_encoder_by_name(choice->encoder);
+        if (!codec || !EncoderSupportsPixelFormat(codec, pix_fmt)) {
+            continue;
+        }
+        ost->context = OpenEncoder(codec, choice->options, live ? choice->live_options : NULL,
+                                   oc, pix_fmt, width, height);
+    }
+    if (!ost->context) {
+        /* Whatever this FFmpeg build would pick, with its default settings */
+        const AVCodecDescriptor* desc = avcodec_descriptor_get_by_name(codec_name);
+        const AVCodec* codec = desc ? avcodec_find_encoder(desc->id) : NULL;
+        if (codec && EncoderSupportsPixelFormat(codec, pix_fmt)) {
+            ost->context = OpenEncoder(codec, "", live ? "" : NULL, oc, pix_fmt, width, height);
+        }
+    }
+    if (!ost->context) {
+        SDL_Log("No %s encoder for %s\n", codec_name, av_get_pix_fmt_name(pix_fmt));
+        return GENMEDIA_UNSUPPORTED;
+    }
+    SDL_Log("Encoding %s %s with %s\n", codec_name, av_get_pix_fmt_name(pix_fmt),
+            ost->context->codec->name);
+
+    ost->frame = av_frame_alloc();
+    if (!ost->frame) {
+        return AVERROR(ENOMEM);
+    }
+    ost->frame->format = pix_fmt;
+    ost->frame->width = width;
+    ost->frame->height = height;
+    return av_frame_get_buffer(ost->frame, 0);
+}
+
+/* Returns 0 on success, GENMEDIA_UNSUPPORTED if there's no usable encoder */
+static int OpenAudioOutput(AVFormatContext* oc, OutputStream* ost, int channels)
+{
+    const AVCodec* codec = avcodec_find_encoder(AV_CODEC_ID_AAC);
+    if (!codec) {
+        SDL_Log("No AAC encoder\n");
+        return GENMEDIA_UNSUPPORTED;
+    }
+
+    ost->context = avcodec_alloc_context3(codec);
+    if (!ost->context) {
+        return AVERROR(ENOMEM);
+    }
+    ost->context->sample_fmt = AV_SAMPLE_FMT_FLTP;
+    ost->context->sample_rate = 48000;
+    ost->context->bit_rate = 64000 * channels;
+    ost->context->time_base = AVRational{1, ost->context->sample_rate};
+    av_channel_layout_default(&ost->context->ch_layout, channels);
+    if (oc->oformat->flags & AVFMT_GLOBALHEADER) {
+        ost->context->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    }
+    int result = avcodec_open2(ost->context, codec, NULL);
+    if (result < 0) {
+        SDL_Log("Couldn't open %s for %d channels: %s\n", codec->name, channels,
+                av_err2str(result));
+        return GENMEDIA_UNSUPPORTED;
+    }
+
+    ost->frame = av_frame_alloc();
+    if (!ost->frame) {
+        return AVERROR(ENOMEM);
+    }
+    ost->frame->format = ost->context->sample_fmt;
+    ost->frame->sample_rate = ost->context->sample_rate;
+    ost->frame->nb_samples = ost->context->frame_size > 0 ? ost->context->frame_size : 1024;
+    av_channel_layout_copy(&ost->frame->ch_layout, &ost->context->ch_layout);
+    return av_frame_get_buffer(ost->frame, 0);
+}
+
+static int AddOutputStream(AVFormatContext* oc, OutputStream* ost)
+{
+    ost->pkt = av_packet_alloc();
+    ost->stream = avformat_new_stream(oc, NULL);
+    if (!ost->pkt || !ost->stream) {
+        return AVERROR(ENOMEM);
+    }
+    ost->stream->time_base = ost->context->time_base;
+    return avcodec_parameters_from_context(ost->stream->codecpar, ost->context);
+}
+
+static void CloseOutputStream(OutputStream* ost)
+{
+    av_packet_free(&ost->pkt);
+    av_frame_free(&ost->frame);
+    avcodec_free_context(&ost->context);
+}
+
+/* Send a frame, or NULL to drain the encoder, and write out any packets */
+static int EncodeFrame(AVFormatContext* oc, OutputStream* ost, AVFrame* frame)
+{
+    int result = avcodec_send_frame(ost->context, frame);
+    if (result < 0) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "avcodec_send_frame failed: %s",
+                     av_err2str(result));
+        return result;
+    }
+    for (;;) {
+        result = avcodec_receive_packet(ost->context, ost->pkt);
+        if (result == AVERROR(EAGAIN) || result == AVERROR_EOF) {
+            return 0;
+        }
+        if (result < 0) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "avcodec_receive_packet failed: %s",
+                         av_err2str(result));
+            return result;
+        }
+        av_packet_rescale_ts(ost->pkt, ost->context->time_base, ost->stream->time_base);
+        ost->pkt->stream_index = ost->stream->index;
+        result = av_interleaved_write_frame(oc, ost->pkt);
+        if (result < 0) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "av_interleaved_write_frame failed: %s",
+                         av_err2str(result));
+            return result;
+        }
+    }
+}
+
+static void DrawVideoPattern(AVFrame* rgb, int index, Uint32* seed)
+{
+    int box = rgb->width / 8;
+    int box_x = (index * 8) % (rgb->width - box);
+    int box_y = (rgb->height - box) / 2;
+
+    for (int y = 0; y < rgb->height; ++y) {
+        Uint8* row = rgb->data[0] + y * rgb->linesize[0];
+        for (int x = 0; x < rgb->width; ++x) {
+            *seed = *seed * 1103515245 + 12345;
+            int noise = (*seed >> 24) & 0x0F;
+            Uint8* pixel = &row[x * 3];
+            if (x >= box_x && x < box_x + box && y >= box_y && y < box_y + box) {
+                pixel[0] = pixel[1] = pixel[2] = (Uint8)(0xF0 - noise);
+            } else {
+                pixel[0] = (Uint8)(x + index * 4 + noise);
+                pixel[1] = (Uint8)(y + index * 2 + noise);
+                pixel[2] = (Uint8)(((x ^ y) >> 2) + index + noise);
+            }
+        }
+    }
+}
+
+static void FillAudioTones(AVFrame* frame, Sint64 pts)
+{
+    for (int c = 0; c < frame->ch_layout.nb_channels; ++c) {
+        float* samples = (float*)frame->data[c];
+        double frequency = 220.0 + 110.0 * c;
+        for (int i = 0; i < frame->nb_samples; ++i) {
+            double t = (double)(pts + i) / frame->sample_rate;
+            samples[i] = 0.2f * (float)SDL_sin(2.0 * SDL_PI_D * frequency * t);
+        }
+    }
+}
+
+static void print_usage(const char* argv0)
+{
+    SDL_Log("Usage: %s output.mkv video_codec pix_fmt [--audio CHANNELS] [--frames N] "
+            "[--size WxH] [--live] [--format NAME]\n",
+            argv0);
+}
+
+int main(int argc, char* argv[])
+{
+    const char* output = NULL;
+    const char* video_codec = NULL;
+    const char* pix_fmt_name = NULL;
+    const char* format_name = NULL;
+    enum AVPixelFormat pix_fmt;
+    SDL_bool live = SDL_FALSE;
+    int channels = 0;
+    int num_frames = -1;
+    int width = 1280;
+    int height = 720;
+    AVFormatContext* oc = NULL;
+    OutputStream video = {};
+    OutputStream audio = {};
+    AVFrame* rgb = NULL;
+    struct SwsContext* sws = NULL;
+    Uint32 seed = 1;
+    SDL_bool header_written = SDL_FALSE;
+    Sint64 live_start = 0;
+    int i;
+    int result;
+    int return_code = 2;
+
+    for (i = 1; i < argc; ++i) {
+        if (SDL_strcmp(argv[i], "--audio") == 0 && argv[i + 1]) {
+            channels = SDL_atoi(argv[++i]);
+        } else if (SDL_strcmp(argv[i], "--frames") == 0 && argv[i + 1]) {
+            num_frames = SDL_atoi(argv[++i]);
+        } else if (SDL_strcmp(argv[i], "--size") == 0 && argv[i + 1]) {
+            if (SDL_sscanf(argv[++i], "%dx%d", &width, &height) != 2) {
+                width = height = 0;
+            }
+        } else if (SDL_strcmp(argv[i], "--live") == 0) {
+            live = SDL_TRUE;
+        } else if (SDL_strcmp(argv[i], "--format") == 0 && argv[i + 1]) {
+            format_name = argv[++i];
+        } else if (argv[i][0] == '-') {
+            break;
+        } else if (!output) {
+            output = argv[i];
+        } else if (!video_codec) {
+            video_codec = argv[i];
+        } else if (!pix_fmt_name) {
+            pix_fmt_name = argv[i];
+        } else {
+            break;
+        }
+    }
+    if (num_frames < 0) {
+        /* A live source runs until it's stopped */
+        num_frames = live ? 0 : 150;
+    }
+    if (i < argc || !pix_fmt_name || (num_frames == 0 && !live) || width <= 0 || height <= 0 ||
+        channels < 0) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    pix_fmt = av_get_pix_fmt(pix_fmt_name);
+    if (pix_fmt == AV_PIX_FMT_NONE) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Unknown pixel format '%s'", pix_fmt_name);
+        return 1;
+    }
+    av_log_set_level(AV_LOG_ERROR);
+
+    result = avformat_alloc_output_context2(&oc, NULL, format_name, output);
+    if (result < 0) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Couldn't create %s: %s", output,
+                     av_err2str(result));
+        goto quit;
+    }
+
+    result = OpenVideoOutput(oc, &video, video_codec, pix_fmt, width, height, live);
+    if (result == 0) {
+        result = AddOutputStream(oc, &video);
+    }
+    if (result == 0 && channels > 0) {
+        result = OpenAudioOutput(oc, &audio, channels);
+        if (result == 0) {
+            result = AddOutputStream(oc, &audio);
+        }
+    }
+    if (result == GENMEDIA_UNSUPPORTED) {
+        return_code = GENMEDIA_UNSUPPORTED;
+        goto quit;
+    }
+    if (result < 0) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Couldn't set up the streams: %s",
+                     av_err2str(result));
+        goto quit;
+    }
+
+    rgb = av_frame_alloc();
+    if (!rgb) {
+        goto quit;
+    }
+    rgb->format = AV_PIX_FMT_RGB24;
+    rgb->width = width;
+    rgb->height = height;
+    if (av_frame_get_buffer(rgb, 0) < 0) {
+        goto quit;
+    }
+    sws = sws_getContext(width, height, AV_PIX_FMT_RGB24, width, height, pix_fmt, SWS_BILINEAR,
+                         NULL, NULL, NULL);
+    if (!sws) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Couldn't convert to %s", pix_fmt_name);
+        goto quit;
+    }
+
+    if (live) {
+        /* Send each packet as soon as it's muxed, instead of filling the I/O buffer first */
+        oc->flags |= AVFMT_FLAG_FLUSH_PACKETS;
+    }
+    if (!(oc->oformat->flags & AVFMT_NOFILE)) {
+        result = avio_open(&oc->pb, output, AVIO_FLAG_WRITE);
+        if (result < 0) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Couldn't open %s: %s", output,
+                         av_err2str(result));
+            goto quit;
+        }
+    }
+    result = avformat_write_header(oc, NULL);
+    if (result < 0) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "avformat_write_header failed: %s",
+                     av_err2str(result));
+        goto quit;
+    }
+    header_written = SDL_TRUE;
+
+    if (live) {
+        live_start = av_gettime_relative();
+    }
+
+    /* Encode whichever stream is behind, so the file is interleaved */
+    while (num_frames == 0 || video.next_pts < num_frames) {
+        if (audio.context && av_compare_ts(audio.next_pts, audio.context->time_base,
+                                           video.next_pts, video.context->time_base) < 0) {
+            if (av_frame_make_writable(audio.frame) < 0) {
+                goto quit;
+            }
+            FillAudioTones(audio.frame, audio.next_pts);
+            audio.frame->pts = audio.next_pts;
+            audio.next_pts += audio.frame->nb_samples;
+            if (EncodeFrame(oc, &audio, audio.frame) < 0) {
+                goto quit;
+            }
+        } else {
+            if (av_frame_make_writable(video.frame) < 0) {
+                goto quit;
+            }
+            DrawVideoPattern(rgb, (int)video.next_pts, &seed);
+            if (live) {
+                /* Wait until the frame is due, then stamp it with the time it went out */
+                Sint64 due = live_start + video.next_pts * 1000000 / GENMEDIA_FRAME_RATE;
+                Sint64 now = av_gettime_relative();
+                if (due > now) {
+                    av_usleep((unsigned int)(due - now));
+                }
+                DrawTimestampPattern(rgb, GetTimestampClockMS());
+            }
+            sws_scale(sws, rgb->data, rgb->linesize, 0, height, video.frame->data,
+                      video.frame->linesize);
+            video.frame->pts = video.next_pts++;
+            if (EncodeFrame(oc, &video, video.frame) < 0) {
+                goto quit;
+            }
+        }
+    }
+    if (EncodeFrame(oc, &video, NULL) < 0) {
+        goto quit;
+    }
+    if (audio.context && EncodeFrame(oc, &audio, NULL) < 0) {
+        goto quit;
+    }
+
+    result = av_write_trailer(oc);
+    if (result < 0) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "av_write_trailer failed: %s",
+                     av_err2str(result));
+        goto quit;
+    }
+    header_written = SDL_FALSE;
+    return_code = 0;
+quit:
+    if (header_written) {
+        av_write_trailer(oc);
+    }
+    sws_freeContext(sws);
+    av_frame_free(&rgb);
+    CloseOutputStream(&audio);
+    CloseOutputStream(&video);
+    if (oc) {
+        if (!(oc->oformat->flags & AVFMT_NOFILE)) {
+            avio_closep(&oc->pb);
+        }
+        avformat_free_context(oc);
+    }
+    if (return_code != 0 && output && !live) {
+        /* Don't leave a partial clip for the benchmarks to play */
+        remove(output);
+    }
+    return return_code;
+}
@@ -0,0 +1,332 @@
+/*
+  Copyright (C) 1997-2024 Sam Lantinga <slouken@libsdl.org>
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely.
+*/
+#include <SDL3/SDL.h>
+
+#ifdef SDL_PLATFORM_LINUX
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+extern "C" {
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+}
+
+#include "testffmpeg_cpu.h"
+#include "testffmpeg_hugepages.h"
+#include "testffmpeg_memory.h"
+
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+/* Matches the padding the default allocator adds for SIMD overreads */
+#define FRAME_ALIGN 64
+#define FRAME_PADDING (16 + FRAME_ALIGN - 1)
+
+/* A frame's planes at least this large are packed into one huge page buffer, smaller planes
+ * don't touch enough memory to be worth it and come from an ordinary pool.
+ */
+#define MIN_HUGE_PAGE_PLANE (HUGE_PAGE_SIZE / 2)
+
+#define MAX_FRAME_POOLS 16
+
+typedef struct FramePool
+{
+    size_t size;
+    SDL_bool hugepages;
+    AVBufferPool* pool;
+} FramePool;
+
+static SDL_Mutex* frame_pool_lock;
+static FramePool frame_pools[MAX_FRAME_POOLS];
+static int num_frame_pools;
+
+/* Statistics, arenas are counted in units of HUGE_PAGE_SIZE. Buffers are huge page buffers,
+ * one per frame.
+ */
+static SDL_AtomicInt frame_requests;
+static SDL_AtomicInt buffer_requests;
+static SDL_AtomicInt buffer_allocations;
+static SDL_AtomicInt arenas_mapped;
+static SDL_AtomicInt arenas_peak;
+static SDL_AtomicInt arenas_hugetlb;
+
+/* The opaque pointer of a buffer holds its arena count, and whether it's in MAP_HUGETLB pages
+ * in the low bit
+ */
+static void FreeHugePageBuffer(void* opaque, uint8_t* data)
+{
+    int arenas = (int)((uintptr_t)opaque >> 1);
+    SDL_bool hugetlb = ((uintptr_t)opaque & 1) ? SDL_TRUE : SDL_FALSE;
+
+#ifdef SDL_PLATFORM_LINUX
+    munmap(data, (size_t)arenas * HUGE_PAGE_SIZE);
+#else
+    SDL_aligned_free(data);
+#endif
+    SDL_AtomicAdd(&arenas_mapped, -arenas);
+    if (hugetlb) {
+        SDL_AtomicAdd(&arenas_hugetlb, -arenas);
+    }
+}
+
+#ifdef SDL_PLATFORM_LINUX
+static void BindToDecodeNodes(void* mem, size_t size)
+{
+    /* MPOL_PREFERRED from <numaif.h>, which needs libnuma headers we don't otherwise use */
+    const int mpol_preferred = 1;
+    unsigned long nodes = (unsigned long)GetThreadRoleNodeMask(CPU_THREAD_DECODE);
+
+    if (nodes) {
+        /* Prefer the lowest node, the pages are placed when first touched */
+        nodes &= ~(nodes - 1);
+        syscall(SYS_mbind, mem, size, mpol_preferred, &nodes, sizeof(nodes) * 8 + 1, 0);
+    }
+}
+#endif
+
+static uint8_t* MapHugePages(size_t size, SDL_bool* hugetlb)
+{
+#ifdef SDL_PLATFORM_LINUX
+    void* mem;
+
+    /* Explicit huge pages first, they're only available if the administrator reserved some */
+    mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1,
+               0);
+    if (mem != MAP_FAILED) {
+        BindToDecodeNodes(mem, size);
+        *hugetlb = SDL_TRUE;
+        return (uint8_t*)mem;
+    }
+
+    /* Otherwise ask for transparent huge pages, which need a 2 MB aligned range */
+    mem = mmap(NULL, size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+               -1, 0);
+    if (mem == MAP_FAILED) {
+        return NULL;
+    }
+    uintptr_t start = (uintptr_t)mem;
+    uintptr_t aligned = (start + HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(HUGE_PAGE_SIZE - 1);
+    if (aligned > start) {
+        munmap(mem, aligned - start);
+    }
+    munmap((void*)(aligned + size), start + HUGE_PAGE_SIZE - aligned);
+#ifdef MADV_HUGEPAGE
+    madvise((void*)aligned, size, MADV_HUGEPAGE);
+#endif
+    BindToDecodeNodes((void*)aligned, size);
+    *hugetlb = SDL_FALSE;
+    return (uint8_t*)aligned;
+#else
+    *hugetlb = SDL_FALSE;
+    return (uint8_t*)SDL_aligned_alloc(HUGE_PAGE_SIZE, size);
+#endif
+}
+
+static AVBufferRef* AllocHugePageBuffer(void* opaque, size_t size)
+{
+    (void)opaque;
+
+    SDL_AtomicAdd(&buffer_allocations, 1);
+
+    int arenas = (int)((size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE);
+    SDL_bool hugetlb;
+    uint8_t* data = MapHugePages((size_t)arenas * HUGE_PAGE_SIZE, &hugetlb);
+    if (!data) {
+        return NULL;
+    }
+
+    AVBufferRef* buffer = av_buffer_create(data, size, FreeHugePageBuffer,
+                                           (void*)(((uintptr_t)arenas << 1) | hugetlb), 0);
+    if (!buffer) {
+#ifdef SDL_PLATFORM_LINUX
+        munmap(data, (size_t)arenas * HUGE_PAGE_SIZE);
+#else
+        SDL_aligned_free(data);
+#endif
+        return NULL;
+    }
+
+    int mapped = SDL_AtomicAdd(&arenas_mapped, arenas) + arenas;
+    int peak;
+    do {
+        peak = SDL_AtomicGet(&arenas_peak);
+    } while (mapped > peak && !SDL_AtomicCompareAndSwap(&arenas_peak, peak, mapped));
+    if (hugetlb) {
+        SDL_AtomicAdd(&arenas_hugetlb, arenas);
+    }
+    return buffer;
+}
+
+static AVBufferPool* GetFramePool(size_t size, SDL_bool hugepages)
+{
+    AVBufferPool* pool = NULL;
+
+    SDL_LockMutex(frame_pool_lock);
+    for (int i = 0; i < num_frame_pools; ++i) {
+        if (frame_pools[i].size == size && frame_pools[i].hugepages == hugepages) {
+            pool = frame_pools[i].pool;
+            break;
+        }
+    }
+    if (!pool && num_frame_pools < MAX_FRAME_POOLS) {
+        if (hugepages) {
+            pool = av_buffer_pool_init2(size, NULL, AllocHugePageBuffer, NULL);
+        } else {
+            pool = av_buffer_pool_init(size, NULL);
+        }
+        if (pool) {
+            frame_pools[num_frame_pools].size = size;
+            frame_pools[num_frame_pools].hugepages = hugepages;
+            frame_pools[num_frame_pools].pool = pool;
+            ++num_frame_pools;
+        }
+    }
+    SDL_UnlockMutex(frame_pool_lock);
+    return pool;
+}
+
+static int GetHugePageFrameBuffer(AVCodecContext* context, AVFrame* frame, int flags)
+{
+    const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get((enum AVPixelFormat)frame->format);
+    int linesize_align[AV_NUM_DATA_POINTERS];
+    int linesizes[4];
+    ptrdiff_t plane_linesizes[4];
+    size_t sizes[4];
+    size_t offsets[4];
+    size_t huge_size = 0;
+    int w = frame->width;
+    int h = frame->height;
+    int planes, buffers;
+    int i;
+
+    if (context->codec_type != AVMEDIA_TYPE_VIDEO || !desc ||
+        (desc->flags & (AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_PAL)) ||
+        !(context->codec->capabilities & AV_CODEC_CAP_DR1)) {
+        return avcodec_default_get_buffer2(context, frame, flags);
+    }
+
+    avcodec_align_dimensions2(context, &w, &h, linesize_align);
+    if (av_image_fill_linesizes(linesizes, (enum AVPixelFormat)frame->format, w) < 0) {
+        return avcodec_default_get_buffer2(context, frame, flags);
+    }
+    for (i = 0; i < 4; ++i) {
+        linesizes[i] = FFALIGN(linesizes[i], FRAME_ALIGN);
+        plane_linesizes[i] = linesizes[i];
+    }
+    if (av_image_fill_plane_sizes(sizes, (enum AVPixelFormat)frame->format, h, plane_linesizes) <
+        0) {
+        return avcodec_default_get_buffer2(context, frame, flags);
+    }
+
+    /* Lay the large planes out one after another, so they share arenas */
+    for (planes = 0; planes < 4 && sizes[planes]; ++planes) {
+        if (sizes[planes] >= MIN_HUGE_PAGE_PLANE) {
+            offsets[planes] = huge_size;
+            huge_size += FFALIGN(sizes[planes] + FRAME_PADDING, FRAME_ALIGN);
+        }
+    }
+    if (!huge_size) {
+        return avcodec_default_get_buffer2(context, frame, flags);
+    }
+
+    SDL_AtomicAdd(&frame_requests, 1);
+    AVBufferPool* pool = GetFramePool(huge_size, SDL_TRUE);
+    if (pool) {
+        SDL_AtomicAdd(&buffer_requests, 1);
+        frame->buf[0] = av_buffer_pool_get(pool);
+    }
+    if (!frame->buf[0]) {
+        return avcodec_default_get_buffer2(context, frame, flags);
+    }
+    buffers = 1;
+    for (i = 0; i < planes; ++i) {
+        if (sizes[i] >= MIN_HUGE_PAGE_PLANE) {
+            frame->data[i] = frame->buf[0]->data + offsets[i];
+        } else {
+            pool = GetFramePool(sizes[i] + FRAME_PADDING, SDL_FALSE);
+            frame->buf[buffers] = pool ? av_buffer_pool_get(pool) : NULL;
+            if (!frame->buf[buffers]) {
+                for (int j = 0; j < buffers; ++j) {
+                    av_buffer_unref(&frame->buf[j]);
+                }
+                for (int j = 0; j < planes; ++j) {
+                    frame->data[j] = NULL;
+                }
+                return avcodec_default_get_buffer2(context, frame, flags);
+            }
+            frame->data[i] = frame->buf[buffers++]->data;
+        }
+        frame->linesize[i] = linesizes[i];
+    }
+    frame->extended_data = frame->data;
+    return 0;
+}
+
+SDL_bool CreateHugePageFrameAllocator(void)
+{
+    frame_pool_lock = SDL_CreateMutex();
+    if (!frame_pool_lock) {
+        return SDL_FALSE;
+    }
+    return SDL_TRUE;
+}
+
+void SetupHugePageCodecContext(AVCodecContext* context)
+{
+    if (frame_pool_lock) {
+        context->get_buffer2 = GetHugePageFrameBuffer;
+    }
+}
+
+void AddHugePageFrameMemory(MemoryReport* report)
+{
+    /* The frames are counted where they're referenced, this is what the pools have mapped */
+    report->frame_pool_mapped = (Uint64)SDL_AtomicGet(&arenas_mapped) * HUGE_PAGE_SIZE;
+}
+
+void LogHugePageFrameStats(void)
+{
+    int requests = SDL_AtomicGet(&buffer_requests);
+    int allocations = SDL_AtomicGet(&buffer_allocations);
+    int pools;
+
+    if (!frame_pool_lock || requests == 0) {
+        return;
+    }
+
+    SDL_LockMutex(frame_pool_lock);
+    pools = num_frame_pools;
+    SDL_UnlockMutex(frame_pool_lock);
+
+    SDL_Log("Huge page frames: %d frames, %d buffers allocated, %.1f%% pool hit rate\n",
+            SDL_AtomicGet(&frame_requests), allocations,
+            allocations < requests ? 100.0 * (requests - allocations) / requests : 0.0);
+    SDL_Log("Huge page frames: %d pools, %d MB peak, %d MB mapped, %d MB of it in MAP_HUGETLB "
+            "pages\n",
+            pools, SDL_AtomicGet(&arenas_peak) * (HUGE_PAGE_SIZE / (1024 * 1024)),
+            SDL_AtomicGet(&arenas_mapped) * (HUGE_PAGE_SIZE / (1024 * 1024)),
+            SDL_AtomicGet(&arenas_hugetlb) * (HUGE_PAGE_SIZE / (1024 * 1024)));
+}
+
+void DestroyHugePageFrameAllocator(void)
+{
+    for (int i = 0; i < num_frame_pools; ++i) {
+        av_buffer_pool_uninit(&frame_pools[i].pool);
+    }
+    num_frame_pools = 0;
+
+    if (frame_pool_lock) {
+        SDL_DestroyMutex(frame_pool_lock);
+        frame_pool_lock = NULL;
+    }
+}
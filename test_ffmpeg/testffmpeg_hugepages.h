@@ -0,0 +1,31 @@
+/*
+  Copyright (C) 1997-2024 Sam Lantinga <slouken@libsdl.org>
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely.
+*/
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+/* Decoded frame buffers pooled in 2 MB huge page arenas, to cut TLB misses on large frames.
+ * The large planes of a frame share one buffer, so only the frame is rounded up to an arena.
+ */
+extern SDL_bool CreateHugePageFrameAllocator(void);
+
+/* Decode into the huge page pools, hardware frames still use the default allocator */
+extern void SetupHugePageCodecContext(AVCodecContext* context);
+
+typedef struct MemoryReport MemoryReport;
+
+extern void AddHugePageFrameMemory(MemoryReport* report);
+extern void LogHugePageFrameStats(void);
+
+/* Buffers still referenced by frames stay valid until they are released */
+extern void DestroyHugePageFrameAllocator(void);
@@ -0,0 +1,294 @@
+/*
+  Copyright (C) 1997-2024 Sam Lantinga <slouken@libsdl.org>
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely.
+*/
+#include <SDL3/SDL.h>
+
+#include <stdio.h>
+#ifdef SDL_PLATFORM_WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+#include "testffmpeg_hwcache.h"
+
+#define HW_CONFIG_CACHE_FILE "hwconfig.txt"
+#define HW_CONFIG_CACHE_HEADER "testffmpeg hardware config cache 1"
+
+typedef struct HWConfigEntry
+{
+    char* key;
+    enum AVHWDeviceType type;
+    SDL_bool success;
+} HWConfigEntry;
+
+struct HWConfigCache
+{
+    char* path;
+    char* host;
+    HWConfigEntry* entries;
+    int num_entries;
+    int max_entries;
+    SDL_bool dirty;
+};
+
+static char* GetHWConfigCachePath(void)
+{
+    char* pref_path = SDL_GetPrefPath("libsdl", "testffmpeg");
+    char* path = NULL;
+
+    if (pref_path) {
+        SDL_asprintf(&path, "%s%s", pref_path, HW_CONFIG_CACHE_FILE);
+        SDL_free(pref_path);
+    }
+    return path;
+}
+
+static char* GetHostKey(void)
+{
+    char name[256];
+    char* host = NULL;
+
+#ifdef SDL_PLATFORM_WIN32
+    DWORD size = sizeof(name);
+    if (!GetComputerNameA(name, &size)) {
+        SDL_strlcpy(name, "unknown", sizeof(name));
+    }
+#else
+    if (gethostname(name, sizeof(name)) < 0) {
+        SDL_strlcpy(name, "unknown", sizeof(name));
+    }
+    name[sizeof(name) - 1] = '\0';
+#endif
+
+    /* A new FFmpeg may fix or break devices, so results don't carry over between versions */
+    SDL_asprintf(&host, "%s %s libavcodec %u", SDL_GetPlatform(), name, avcodec_version());
+    return host;
+}
+
+static char* GetEntryKey(HWConfigCache* cache, const char* codec, const char* renderer)
+{
+    char* key = NULL;
+
+    SDL_asprintf(&key, "%s|%s|%s", cache->host, codec, renderer ? renderer : "none");
+    return key;
+}
+
+static HWConfigEntry* FindEntry(HWConfigCache* cache, const char* key, enum AVHWDeviceType type)
+{
+    for (int i = 0; i < cache->num_entries; ++i) {
+        HWConfigEntry* entry = &cache->entries[i];
+        if (SDL_strcmp(entry->key, key) == 0 &&
+            (type == AV_HWDEVICE_TYPE_NONE || entry->type == type)) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static HWConfigEntry* AddEntry(HWConfigCache* cache, char* key, enum AVHWDeviceType type)
+{
+    if (cache->num_entries == cache->max_entries) {
+        int max_entries = cache->max_entries ? cache->max_entries * 2 : 16;
+        HWConfigEntry* entries = (HWConfigEntry*)SDL_realloc(
+            cache->entries, max_entries * sizeof(*entries));
+        if (!entries) {
+            return NULL;
+        }
+        cache->entries = entries;
+        cache->max_entries = max_entries;
+    }
+
+    HWConfigEntry* entry = &cache->entries[cache->num_entries++];
+    entry->key = key;
+    entry->type = type;
+    entry->success = SDL_FALSE;
+    return entry;
+}
+
+static void ParseHWConfigCache(HWConfigCache* cache, char* text)
+{
+    char* saveptr = NULL;
+    char* line = SDL_strtok_r(text, "\n", &saveptr);
+
+    if (!line || SDL_strcmp(line, HW_CONFIG_CACHE_HEADER) != 0) {
+        /* Unknown format, start over */
+        return;
+    }
+
+    /* Each line is: key <tab> device type <tab> ok|fail */
+    while ((line = SDL_strtok_r(NULL, "\n", &saveptr)) != NULL) {
+        char* type_name = SDL_strchr(line, '\t');
+        char* result = type_name ? SDL_strchr(type_name + 1, '\t') : NULL;
+        if (!result) {
+            continue;
+        }
+        *type_name++ = '\0';
+        *result++ = '\0';
+
+        enum AVHWDeviceType type = av_hwdevice_find_type_by_name(type_name);
+        if (type == AV_HWDEVICE_TYPE_NONE || FindEntry(cache, line, type)) {
+            continue;
+        }
+
+        char* key = SDL_strdup(line);
+        HWConfigEntry* entry = key ? AddEntry(cache, key, type) : NULL;
+        if (!entry) {
+            SDL_free(key);
+            break;
+        }
+        entry->success = (SDL_strcmp(result, "ok") == 0);
+    }
+}
+
+HWConfigCache* LoadHWConfigCache(void)
+{
+    HWConfigCache* cache = (HWConfigCache*)SDL_calloc(1, sizeof(*cache));
+    if (!cache) {
+        return NULL;
+    }
+
+    cache->path = GetHWConfigCachePath();
+    cache->host = GetHostKey();
+    if (!cache->path || !cache->host) {
+        DestroyHWConfigCache(cache);
+        return NULL;
+    }
+
+    char* text = (char*)SDL_LoadFile(cache->path, NULL);
+    if (text) {
+        ParseHWConfigCache(cache, text);
+        SDL_free(text);
+    }
+    return cache;
+}
+
+void ClearHWConfigCache(void)
+{
+    char* path = GetHWConfigCachePath();
+
+    if (path) {
+        remove(path);
+        SDL_free(path);
+    }
+}
+
+SDL_bool GetHWConfigCacheWinner(HWConfigCache* cache,
+                                const char* codec,
+                                const char* renderer,
+                                enum AVHWDeviceType* type)
+{
+    SDL_bool found = SDL_FALSE;
+    char* key;
+
+    if (!cache || (key = GetEntryKey(cache, codec, renderer)) == NULL) {
+        return SDL_FALSE;
+    }
+    for (int i = 0; i < cache->num_entries; ++i) {
+        HWConfigEntry* entry = &cache->entries[i];
+        if (entry->success && SDL_strcmp(entry->key, key) == 0) {
+            *type = entry->type;
+            found = SDL_TRUE;
+            break;
+        }
+    }
+    SDL_free(key);
+    return found;
+}
+
+SDL_bool IsHWConfigCacheFailure(HWConfigCache* cache,
+                                const char* codec,
+                                const char* renderer,
+                                enum AVHWDeviceType type)
+{
+    HWConfigEntry* entry;
+    char* key;
+
+    if (!cache || (key = GetEntryKey(cache, codec, renderer)) == NULL) {
+        return SDL_FALSE;
+    }
+    entry = FindEntry(cache, key, type);
+    SDL_free(key);
+    return (entry && !entry->success);
+}
+
+void SetHWConfigCacheResult(HWConfigCache* cache,
+                            const char* codec,
+                            const char* renderer,
+                            enum AVHWDeviceType type,
+                            SDL_bool success)
+{
+    HWConfigEntry* entry;
+    char* key;
+
+    if (!cache || (key = GetEntryKey(cache, codec, renderer)) == NULL) {
+        return;
+    }
+
+    entry = FindEntry(cache, key, type);
+    if (entry) {
+        SDL_free(key);
+        if (entry->success == success) {
+            return;
+        }
+    } else {
+        entry = AddEntry(cache, key, type);
+        if (!entry) {
+            SDL_free(key);
+            return;
+        }
+    }
+    entry->success = success;
+    cache->dirty = SDL_TRUE;
+}
+
+void SaveHWConfigCache(HWConfigCache* cache)
+{
+    SDL_IOStream* io;
+
+    if (!cache || !cache->dirty) {
+        return;
+    }
+
+    io = SDL_IOFromFile(cache->path, "w");
+    if (!io) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Couldn't write %s: %s", cache->path,
+                    SDL_GetError());
+        return;
+    }
+    SDL_IOprintf(io, "%s\n", HW_CONFIG_CACHE_HEADER);
+    for (int i = 0; i < cache->num_entries; ++i) {
+        HWConfigEntry* entry = &cache->entries[i];
+        SDL_IOprintf(io, "%s\t%s\t%s\n", entry->key, av_hwdevice_get_type_name(entry->type),
+                     entry->success ? "ok" : "fail");
+    }
+    SDL_CloseIO(io);
+    cache->dirty = SDL_FALSE;
+}
+
+void DestroyHWConfigCache(HWConfigCache* cache)
+{
+    if (!cache) {
+        return;
+    }
+
+    for (int i = 0; i < cache->num_entries; ++i) {
+        SDL_free(cache->entries[i].key);
+    }
+    SDL_free(cache->entries);
+    SDL_free(cache->host);
+    SDL_free(cache->path);
+    SDL_free(cache);
+}
@@ -0,0 +1,43 @@
+/*
+  Copyright (C) 1997-2024 Sam Lantinga <slouken@libsdl.org>
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely.
+*/
+
+extern "C" {
+#include <libavutil/hwcontext.h>
+}
+
+/* Remembers which hardware device types worked or failed for each codec and renderer on this
+ * host, so later runs try the winner first and skip devices that are known not to work.
+ */
+typedef struct HWConfigCache HWConfigCache;
+
+extern HWConfigCache* LoadHWConfigCache(void);
+
+/* Delete the cache file, so every configuration is tried again */
+extern void ClearHWConfigCache(void);
+
+extern SDL_bool GetHWConfigCacheWinner(HWConfigCache* cache,
+                                       const char* codec,
+                                       const char* renderer,
+                                       enum AVHWDeviceType* type);
+extern SDL_bool IsHWConfigCacheFailure(HWConfigCache* cache,
+                                       const char* codec,
+                                       const char* renderer,
+                                       enum AVHWDeviceType type);
+extern void SetHWConfigCacheResult(HWConfigCache* cache,
+                                   const char* codec,
+                                   const char* renderer,
+                                   enum AVHWDeviceType type,
+                                   SDL_bool success);
+
+/* Write the cache back to disk if it changed */
+extern void SaveHWConfigCache(HWConfigCache* cache);
+extern void DestroyHWConfigCache(HWConfigCache* cache);
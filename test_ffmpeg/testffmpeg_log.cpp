@@ -0,0 +1,180 @@
+/*
+  Copyright (C) 1997-2024 Sam Lantinga <slouken@libsdl.org>
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely.
+*/
+#include <SDL3/SDL.h>
+
+#include "testffmpeg_log.h"
+
+/* Must be a power of two */
+#define LOG_RING_SIZE 1024
+#define LOG_MESSAGE_SIZE 256
+
+/* The drain thread sleeps until a message is published into an empty ring, this only bounds
+ * how long a missed wakeup could delay a message
+ */
+#define LOG_DRAIN_FALLBACK_MS 1000
+
+/* A bounded multi-producer queue (Dmitry Vyukov's design). Each slot carries a sequence number:
+ * a producer owns the slot at position pos when sequence == pos, and hands it to the consumer by
+ * setting sequence to pos + 1. The consumer hands it back by setting pos + LOG_RING_SIZE.
+ */
+typedef struct LogSlot
+{
+    SDL_AtomicInt sequence;
+    char text[LOG_MESSAGE_SIZE];
+} LogSlot;
+
+static LogSlot log_ring[LOG_RING_SIZE];
+static SDL_AtomicInt log_head;
+static SDL_AtomicInt log_tail;
+static SDL_AtomicInt log_dropped;
+static SDL_AtomicInt log_running;
+static SDL_Thread* log_thread;
+
+/* Set while the log thread waits on log_wake, so producers only post when it's needed */
+static SDL_AtomicInt log_sleeping;
+static SDL_Semaphore* log_wake;
+
+static SDL_bool DrainAsyncLog(void)
+{
+    SDL_bool drained = SDL_FALSE;
+
+    /* Only the log thread (or StopAsyncLog() after it has exited) consumes, so the tail is ours */
+    for (;;) {
+        int pos = SDL_AtomicGet(&log_tail);
+        LogSlot* slot = &log_ring[pos & (LOG_RING_SIZE - 1)];
+
+        if (SDL_AtomicGet(&slot->sequence) != pos + 1) {
+            break;
+        }
+        SDL_Log("%s", slot->text);
+        SDL_AtomicSet(&log_tail, pos + 1);
+        SDL_AtomicSet(&slot->sequence, pos + LOG_RING_SIZE);
+        drained = SDL_TRUE;
+    }
+    return drained;
+}
+
+static int SDLCALL AsyncLogThread(void* data)
+{
+    (void)data;
+
+    while (SDL_AtomicGet(&log_running)) {
+        if (DrainAsyncLog()) {
+            continue;
+        }
+
+        SDL_AtomicSet(&log_sleeping, 1);
+        /* A message published before the flag was set didn't post, so look once more */
+        if (!DrainAsyncLog() && SDL_AtomicGet(&log_running)) {
+            SDL_WaitSemaphoreTimeout(log_wake, LOG_DRAIN_FALLBACK_MS);
+        }
+        SDL_AtomicSet(&log_sleeping, 0);
+    }
+    return 0;
+}
+
+static void WakeAsyncLog(void)
+{
+    /* Only the producer that clears the flag posts, so one wait gets one post */
+    if (SDL_AtomicGet(&log_sleeping) && SDL_AtomicCompareAndSwap(&log_sleeping, 1, 0)) {
+        SDL_PostSemaphore(log_wake);
+    }
+}
+
+SDL_bool StartAsyncLog(void)
+{
+    for (int i = 0; i < LOG_RING_SIZE; ++i) {
+        SDL_AtomicSet(&log_ring[i].sequence, i);
+    }
+    SDL_AtomicSet(&log_head, 0);
+    SDL_AtomicSet(&log_tail, 0);
+    SDL_AtomicSet(&log_dropped, 0);
+    SDL_AtomicSet(&log_sleeping, 0);
+
+    log_wake = SDL_CreateSemaphore(0);
+    if (!log_wake) {
+        return SDL_FALSE;
+    }
+
+    SDL_AtomicSet(&log_running, 1);
+    log_thread = SDL_CreateThread(AsyncLogThread, "log", NULL);
+    if (!log_thread) {
+        SDL_AtomicSet(&log_running, 0);
+        SDL_DestroySemaphore(log_wake);
+        log_wake = NULL;
+        return SDL_FALSE;
+    }
+    return SDL_TRUE;
+}
+
+void AsyncLogV(const char* prefix, const char* fmt, va_list ap)
+{
+    LogSlot* slot;
+    int pos;
+
+    if (!SDL_AtomicGet(&log_running)) {
+        /* Nobody to hand the message to, log it directly */
+        char* message = NULL;
+
+        SDL_vasprintf(&message, fmt, ap);
+        SDL_Log("%s%s", prefix, message ? message : "");
+        SDL_free(message);
+        return;
+    }
+
+    pos = SDL_AtomicGet(&log_head);
+    for (;;) {
+        slot = &log_ring[pos & (LOG_RING_SIZE - 1)];
+
+        int diff = SDL_AtomicGet(&slot->sequence) - pos;
+        if (diff == 0) {
+            if (SDL_AtomicCompareAndSwap(&log_head, pos, pos + 1)) {
+                break;
+            }
+            pos = SDL_AtomicGet(&log_head);
+        } else if (diff < 0) {
+            /* The ring is full, drop the message rather than wait for the log thread */
+            SDL_AtomicAdd(&log_dropped, 1);
+            return;
+        } else {
+            pos = SDL_AtomicGet(&log_head);
+        }
+    }
+
+    size_t length = SDL_strlcpy(slot->text, prefix, sizeof(slot->text));
+    if (length < sizeof(slot->text)) {
+        SDL_vsnprintf(slot->text + length, sizeof(slot->text) - length, fmt, ap);
+    }
+    SDL_AtomicSet(&slot->sequence, pos + 1);
+    WakeAsyncLog();
+}
+
+void StopAsyncLog(void)
+{
+    if (!log_thread) {
+        return;
+    }
+
+    SDL_AtomicSet(&log_running, 0);
+    SDL_PostSemaphore(log_wake);
+    SDL_WaitThread(log_thread, NULL);
+    log_thread = NULL;
+    SDL_DestroySemaphore(log_wake);
+    log_wake = NULL;
+
+    DrainAsyncLog();
+
+    int dropped = SDL_AtomicGet(&log_dropped);
+    if (dropped > 0) {
+        SDL_Log("Dropped %d log messages\n", dropped);
+    }
+}
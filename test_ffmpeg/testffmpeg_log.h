@@ -0,0 +1,21 @@
+/*
+  Copyright (C) 1997-2024 Sam Lantinga <slouken@libsdl.org>
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely.
+*/
+
+/* Logging that is safe to call from decoder threads: messages are formatted into a preallocated
+ * lock-free ring and written to the SDL log by a background thread. When the ring is full the
+ * message is dropped and counted rather than making the caller wait.
+ */
+extern SDL_bool StartAsyncLog(void);
+extern void AsyncLogV(const char* prefix, const char* fmt, va_list ap);
+
+/* Flush any pending messages and report how many were dropped */
+extern void StopAsyncLog(void);
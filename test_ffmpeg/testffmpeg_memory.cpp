@@ -0,0 +1,180 @@
+/*
+  Copyright (C) 1997-2024 Sam Lantinga <slouken@libsdl.org>
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely.
+*/
+#include <SDL3/SDL.h>
+
+#ifdef SDL_PLATFORM_WIN32
+#include <windows.h>
+#include <psapi.h>
+#elif !defined(SDL_PLATFORM_LINUX)
+#include <sys/resource.h>
+#endif
+
+extern "C" {
+#include <libavutil/opt.h>
+}
+
+#include "testffmpeg_memory.h"
+
+/* Rows of intermediate samples a scaler keeps per image width, a rough upper bound */
+#define SWS_CONTEXT_ESTIMATED_ROWS 32
+
+static const char* memory_category_names[MEMORY_CATEGORY_COUNT] = {
+    "packets", "frames", "textures", "sws contexts", "audio",
+};
+static Uint64 memory_peak[MEMORY_CATEGORY_COUNT];
+
+Uint64 GetPacketMemory(const AVPacket* packet)
+{
+    if (!packet || !packet->buf) {
+        return 0;
+    }
+    return packet->buf->size;
+}
+
+Uint64 GetFrameMemory(const AVFrame* frame)
+{
+    Uint64 bytes = 0;
+
+    if (!frame) {
+        return 0;
+    }
+    for (int i = 0; i < AV_NUM_DATA_POINTERS && frame->buf[i]; ++i) {
+        bytes += frame->buf[i]->size;
+    }
+    for (int i = 0; i < frame->nb_extended_buf; ++i) {
+        bytes += frame->extended_buf[i]->size;
+    }
+    return bytes;
+}
+
+Uint64 GetTextureMemory(SDL_Texture* texture)
+{
+    if (!texture) {
+        return 0;
+    }
+
+    SDL_PropertiesID props = SDL_GetTextureProperties(texture);
+    SDL_PixelFormatEnum format = (SDL_PixelFormatEnum)SDL_GetNumberProperty(
+        props, SDL_PROP_TEXTURE_FORMAT_NUMBER, SDL_PIXELFORMAT_UNKNOWN);
+    Uint64 w = (Uint64)SDL_GetNumberProperty(props, SDL_PROP_TEXTURE_WIDTH_NUMBER, 0);
+    Uint64 h = (Uint64)SDL_GetNumberProperty(props, SDL_PROP_TEXTURE_HEIGHT_NUMBER, 0);
+    Uint64 chroma = ((w + 1) / 2) * ((h + 1) / 2);
+
+    switch (format) {
+        case SDL_PIXELFORMAT_YV12:
+        case SDL_PIXELFORMAT_IYUV:
+        case SDL_PIXELFORMAT_NV12:
+        case SDL_PIXELFORMAT_NV21:
+            return w * h + 2 * chroma;
+        case SDL_PIXELFORMAT_P010:
+            return 2 * (w * h + 2 * chroma);
+        case SDL_PIXELFORMAT_UNKNOWN:
+            /* External textures, assume 32-bit pixels */
+            return w * h * 4;
+        default:
+            return w * h * SDL_BYTESPERPIXEL(format);
+    }
+}
+
+Uint64 GetSwsContextMemory(struct SwsContext* context)
+{
+    int64_t src_w = 0;
+    int64_t dst_w = 0;
+
+    if (!context) {
+        return 0;
+    }
+    av_opt_get_int(context, "srcw", 0, &src_w);
+    av_opt_get_int(context, "dstw", 0, &dst_w);
+    return (Uint64)(src_w + dst_w) * 4 * sizeof(int32_t) * SWS_CONTEXT_ESTIMATED_ROWS;
+}
+
+void AddMemory(MemoryReport* report, MemoryCategory category, Uint64 bytes)
+{
+    report->bytes[category] += bytes;
+    if (bytes > 0) {
+        ++report->count[category];
+    }
+}
+
+static SDL_bool GetProcessMemory(Uint64* rss, Uint64* peak_rss)
+{
+#ifdef SDL_PLATFORM_LINUX
+    char* status = (char*)SDL_LoadFile("/proc/self/status", NULL);
+    if (!status) {
+        return SDL_FALSE;
+    }
+
+    /* Both are reported in kB */
+    char* line = SDL_strstr(status, "VmRSS:");
+    *rss = line ? (Uint64)SDL_strtoull(line + 6, NULL, 10) * 1024 : 0;
+    line = SDL_strstr(status, "VmHWM:");
+    *peak_rss = line ? (Uint64)SDL_strtoull(line + 6, NULL, 10) * 1024 : 0;
+    SDL_free(status);
+    return SDL_TRUE;
+#elif defined(SDL_PLATFORM_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return SDL_FALSE;
+    }
+    *rss = counters.WorkingSetSize;
+    *peak_rss = counters.PeakWorkingSetSize;
+    return SDL_TRUE;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) < 0) {
+        return SDL_FALSE;
+    }
+    /* Only the peak is available, and it's in bytes on Apple platforms */
+    *rss = 0;
+#ifdef SDL_PLATFORM_APPLE
+    *peak_rss = (Uint64)usage.ru_maxrss;
+#else
+    *peak_rss = (Uint64)usage.ru_maxrss * 1024;
+#endif
+    return SDL_TRUE;
+#endif
+}
+
+static double GetMB(Uint64 bytes)
+{
+    return (double)bytes / (1024.0 * 1024.0);
+}
+
+void LogMemoryReport(const MemoryReport* report)
+{
+    Uint64 rss = 0, peak_rss = 0;
+    Uint64 total = 0;
+
+    for (int i = 0; i < MEMORY_CATEGORY_COUNT; ++i) {
+        memory_peak[i] = SDL_max(memory_peak[i], report->bytes[i]);
+        total += report->bytes[i];
+    }
+
+    if (GetProcessMemory(&rss, &peak_rss)) {
+        SDL_Log("Memory: %.1f MB RSS, %.1f MB peak RSS, %.1f MB accounted for\n", GetMB(rss),
+                GetMB(peak_rss), GetMB(total));
+    } else {
+        SDL_Log("Memory: %.1f MB accounted for\n", GetMB(total));
+    }
+    for (int i = 0; i < MEMORY_CATEGORY_COUNT; ++i) {
+        SDL_Log("    %-12s %4d buffers, %8.2f MB, %8.2f MB peak\n", memory_category_names[i],
+                report->count[i], GetMB(report->bytes[i]), GetMB(memory_peak[i]));
+    }
+    SDL_Log("    audio queue  %8.2f KB in the ring, %.2f KB in the SDL audio stream\n",
+            (double)report->audio_ring_queued / 1024.0,
+            (double)report->audio_stream_queued / 1024.0);
+    if (report->frame_pool_mapped > 0) {
+        /* Pooled buffers stay mapped after the frames using them are released */
+        SDL_Log("    frame pools  %8.2f MB mapped\n", GetMB(report->frame_pool_mapped));
+    }
+}
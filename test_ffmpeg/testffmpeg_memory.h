@@ -0,0 +1,54 @@
+/*
+  Copyright (C) 1997-2024 Sam Lantinga <slouken@libsdl.org>
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely.
+*/
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
+}
+
+/* Where the player's memory is held, for --mem-report */
+typedef enum MemoryCategory
+{
+    MEMORY_PACKETS,
+    MEMORY_FRAMES,
+    MEMORY_TEXTURES,
+    MEMORY_SWS,
+    MEMORY_AUDIO,
+    MEMORY_CATEGORY_COUNT
+} MemoryCategory;
+
+/* A snapshot of the buffers the player holds, filled in by walking them */
+typedef struct MemoryReport
+{
+    Uint64 bytes[MEMORY_CATEGORY_COUNT];
+    int count[MEMORY_CATEGORY_COUNT];
+
+    /* Cross-checks, from the audio stream and the huge page buffer pools */
+    Uint64 audio_ring_queued;
+    Uint64 audio_stream_queued;
+    Uint64 frame_pool_mapped;
+} MemoryReport;
+
+/* The bytes referenced by a packet or frame, shared buffers are counted in full */
+extern Uint64 GetPacketMemory(const AVPacket* packet);
+extern Uint64 GetFrameMemory(const AVFrame* frame);
+
+/* Estimated from the texture format and size, the renderer may pad or convert it */
+extern Uint64 GetTextureMemory(SDL_Texture* texture);
+
+/* libswscale doesn't expose its allocations, so this is estimated from the image widths */
+extern Uint64 GetSwsContextMemory(struct SwsContext* context);
+
+extern void AddMemory(MemoryReport* report, MemoryCategory category, Uint64 bytes);
+
+/* Log the snapshot with the process RSS, and the peak of each category across reports */
+extern void LogMemoryReport(const MemoryReport* report);
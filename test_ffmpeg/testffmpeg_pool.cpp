@@ -0,0 +1,271 @@
+/*
+  Copyright (C) 1997-2024 Sam Lantinga <slouken@libsdl.org>
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely.
+*/
+#include <SDL3/SDL.h>
+
+#include "testffmpeg_cpu.h"
+#include "testffmpeg_pool.h"
+#include "testffmpeg_trace.h"
+
+typedef struct WorkerTask
+{
+    WorkerTaskFunction function;
+    void* userdata;
+    struct WorkerTask* next;
+} WorkerTask;
+
+/* Shared between the caller of RunWorkerPoolRange() and the helper tasks it queued.
+ * Helpers may start after the range is complete, so the last reference frees it.
+ */
+typedef struct WorkerRange
+{
+    WorkerPool* pool;
+    WorkerRangeFunction function;
+    void* userdata;
+    int count;
+    SDL_AtomicInt next;
+    SDL_AtomicInt remaining;
+    SDL_AtomicInt refcount;
+} WorkerRange;
+
+struct WorkerPool
+{
+    SDL_Mutex* lock;
+    SDL_Condition* task_available;
+    SDL_Condition* range_finished;
+    SDL_Thread** threads;
+    int num_threads;
+    WorkerTask* head;
+    WorkerTask* tail;
+    WorkerTask* free_tasks;
+    SDL_bool quit;
+};
+
+static int SDLCALL WorkerThread(void* data)
+{
+    WorkerPool* pool = (WorkerPool*)data;
+
+    /* Pool threads decode, so they share the decoder CPUs */
+    PinCurrentThread(CPU_THREAD_DECODE);
+    SetTraceThreadName("worker");
+
+    SDL_LockMutex(pool->lock);
+    for (;;) {
+        while (!pool->head && !pool->quit) {
+            SDL_WaitCondition(pool->task_available, pool->lock);
+        }
+        if (!pool->head) {
+            break;
+        }
+
+        WorkerTask* task = pool->head;
+        pool->head = task->next;
+        if (!pool->head) {
+            pool->tail = NULL;
+        }
+        WorkerTaskFunction function = task->function;
+        void* userdata = task->userdata;
+        task->next = pool->free_tasks;
+        pool->free_tasks = task;
+        SDL_UnlockMutex(pool->lock);
+
+        function(userdata);
+
+        SDL_LockMutex(pool->lock);
+    }
+    SDL_UnlockMutex(pool->lock);
+    return 0;
+}
+
+WorkerPool* CreateWorkerPool(int num_threads)
+{
+    WorkerPool* pool = static_cast<WorkerPool*>(SDL_calloc(1, sizeof(*pool)));
+    if (!pool) {
+        return NULL;
+    }
+    if (num_threads < 1) {
+        num_threads = 1;
+    }
+
+    pool->lock = SDL_CreateMutex();
+    pool->task_available = SDL_CreateCondition();
+    pool->range_finished = SDL_CreateCondition();
+    pool->threads = static_cast<SDL_Thread**>(SDL_calloc(num_threads, sizeof(*pool->threads)));
+    if (!pool->lock || !pool->task_available || !pool->range_finished || !pool->threads) {
+        DestroyWorkerPool(pool);
+        return NULL;
+    }
+
+    for (int i = 0; i < num_threads; ++i) {
+        char name[32];
+        SDL_snprintf(name, sizeof(name), "worker%d", i);
+        pool->threads[i] = SDL_CreateThread(WorkerThread, name, pool);
+        if (!pool->threads[i]) {
+            break;
+        }
+        ++pool->num_threads;
+    }
+    if (pool->num_threads == 0) {
+        DestroyWorkerPool(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+int GetWorkerPoolThreadCount(WorkerPool* pool)
+{
+    return pool ? pool->num_threads : 0;
+}
+
+SDL_bool SubmitWorkerTask(WorkerPool* pool, WorkerTaskFunction function, void* userdata)
+{
+    WorkerTask* task;
+
+    SDL_LockMutex(pool->lock);
+    task = pool->free_tasks;
+    if (task) {
+        pool->free_tasks = task->next;
+    } else {
+        task = static_cast<WorkerTask*>(SDL_malloc(sizeof(*task)));
+        if (!task) {
+            SDL_UnlockMutex(pool->lock);
+            return SDL_FALSE;
+        }
+    }
+    task->function = function;
+    task->userdata = userdata;
+    task->next = NULL;
+    if (pool->tail) {
+        pool->tail->next = task;
+    } else {
+        pool->head = task;
+    }
+    pool->tail = task;
+    SDL_SignalCondition(pool->task_available);
+    SDL_UnlockMutex(pool->lock);
+    return SDL_TRUE;
+}
+
+static void ReleaseWorkerRange(WorkerRange* range)
+{
+    if (SDL_AtomicAdd(&range->refcount, -1) == 1) {
+        SDL_free(range);
+    }
+}
+
+static void RunWorkerRangeItems(WorkerRange* range)
+{
+    int index;
+
+    while ((index = SDL_AtomicAdd(&range->next, 1)) < range->count) {
+        range->function(range->userdata, index);
+
+        if (SDL_AtomicAdd(&range->remaining, -1) == 1) {
+            WorkerPool* pool = range->pool;
+
+            SDL_LockMutex(pool->lock);
+            SDL_BroadcastCondition(pool->range_finished);
+            SDL_UnlockMutex(pool->lock);
+        }
+    }
+}
+
+static void WorkerRangeTask(void* userdata)
+{
+    WorkerRange* range = (WorkerRange*)userdata;
+
+    RunWorkerRangeItems(range);
+    ReleaseWorkerRange(range);
+}
+
+void RunWorkerPoolRange(WorkerPool* pool, int count, WorkerRangeFunction function, void* userdata)
+{
+    WorkerRange* range = NULL;
+    int helpers = 0;
+
+    if (count <= 0) {
+        return;
+    }
+    if (pool && count > 1) {
+        helpers = SDL_min(count - 1, pool->num_threads);
+        range = static_cast<WorkerRange*>(SDL_calloc(1, sizeof(*range)));
+    }
+    if (!range) {
+        /* Nothing to share the work with, run it here */
+        for (int i = 0; i < count; ++i) {
+            function(userdata, i);
+        }
+        return;
+    }
+
+    range->pool = pool;
+    range->function = function;
+    range->userdata = userdata;
+    range->count = count;
+    SDL_AtomicSet(&range->next, 0);
+    SDL_AtomicSet(&range->remaining, count);
+    SDL_AtomicSet(&range->refcount, 1 + helpers);
+    for (int i = 0; i < helpers; ++i) {
+        if (!SubmitWorkerTask(pool, WorkerRangeTask, range)) {
+            SDL_AtomicAdd(&range->refcount, -1);
+        }
+    }
+
+    /* The caller works too, so the range completes even if every pool thread is busy */
+    RunWorkerRangeItems(range);
+
+    SDL_LockMutex(pool->lock);
+    while (SDL_AtomicGet(&range->remaining) > 0) {
+        SDL_WaitCondition(pool->range_finished, pool->lock);
+    }
+    SDL_UnlockMutex(pool->lock);
+
+    ReleaseWorkerRange(range);
+}
+
+void DestroyWorkerPool(WorkerPool* pool)
+{
+    if (!pool) {
+        return;
+    }
+
+    if (pool->lock) {
+        SDL_LockMutex(pool->lock);
+        pool->quit = SDL_TRUE;
+        SDL_BroadcastCondition(pool->task_available);
+        SDL_UnlockMutex(pool->lock);
+    }
+    for (int i = 0; i < pool->num_threads; ++i) {
+        SDL_WaitThread(pool->threads[i], NULL);
+    }
+    SDL_free(pool->threads);
+
+    while (pool->head) {
+        WorkerTask* task = pool->head;
+        pool->head = task->next;
+        SDL_free(task);
+    }
+    while (pool->free_tasks) {
+        WorkerTask* task = pool->free_tasks;
+        pool->free_tasks = task->next;
+        SDL_free(task);
+    }
+    if (pool->range_finished) {
+        SDL_DestroyCondition(pool->range_finished);
+    }
+    if (pool->task_available) {
+        SDL_DestroyCondition(pool->task_available);
+    }
+    if (pool->lock) {
+        SDL_DestroyMutex(pool->lock);
+    }
+    SDL_free(pool);
+}
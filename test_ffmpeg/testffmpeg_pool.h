@@ -0,0 +1,33 @@
+/*
+  Copyright (C) 1997-2024 Sam Lantinga <slouken@libsdl.org>
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely.
+*/
+
+/* A bounded set of worker threads shared by the video wall decoders and the sprite layer */
+typedef struct WorkerPool WorkerPool;
+
+typedef void (*WorkerTaskFunction)(void* userdata);
+typedef void (*WorkerRangeFunction)(void* userdata, int index);
+
+extern WorkerPool* CreateWorkerPool(int num_threads);
+extern int GetWorkerPoolThreadCount(WorkerPool* pool);
+
+/* Queue a task, it will run on one of the pool threads */
+extern SDL_bool SubmitWorkerTask(WorkerPool* pool, WorkerTaskFunction function, void* userdata);
+
+/* Run function(userdata, 0..count-1) across the pool and the calling thread, and wait for it.
+ * This is safe to call from a pool task, the caller never waits for work that hasn't started.
+ */
+extern void RunWorkerPoolRange(WorkerPool* pool,
+                               int count,
+                               WorkerRangeFunction function,
+                               void* userdata);
+
+extern void DestroyWorkerPool(WorkerPool* pool);
@@ -0,0 +1,444 @@
+/*
+  Copyright (C) 1997-2024 Sam Lantinga <slouken@libsdl.org>
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely.
+*/
+#include <SDL3/SDL.h>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libswscale/swscale.h>
+}
+
+#include "testffmpeg_memory.h"
+#include "testffmpeg_record.h"
+#include "testffmpeg_trace.h"
+
+typedef struct RecordedFrame
+{
+    SDL_Surface* surface;
+    Sint64 pts; /* milliseconds since the first recorded frame */
+} RecordedFrame;
+
+struct VideoRecorder
+{
+    char* path;
+    int threads;
+    SDL_Thread* thread;
+
+    /* Protected by lock */
+    SDL_Mutex* lock;
+    SDL_Condition* frame_ready;
+    RecordedFrame queue[VIDEO_RECORDER_QUEUE_SIZE];
+    int head;
+    int count;
+    SDL_bool quit;
+    SDL_bool failed;
+    int encoded;
+    Uint64 encode_ticks;
+
+    /* Only used by the render thread */
+    Uint64 start_ticks;
+    Sint64 last_pts;
+    int read_back;
+    int dropped;
+    Uint64 read_ticks;
+
+    /* Only used by the encoder thread */
+    AVFormatContext* oc;
+    AVStream* stream;
+    AVCodecContext* context;
+    AVFrame* frame;
+    AVPacket* pkt;
+    struct SwsContext* sws;
+    SDL_bool header_written;
+};
+
+static enum AVPixelFormat GetSurfacePixelFormat(Uint32 format)
+{
+    switch (format) {
+        case SDL_PIXELFORMAT_ARGB8888:
+            return AV_PIX_FMT_RGB32;
+        case SDL_PIXELFORMAT_ABGR8888:
+            return AV_PIX_FMT_BGR32;
+        case SDL_PIXELFORMAT_XRGB8888:
+            return AV_PIX_FMT_0RGB32;
+        case SDL_PIXELFORMAT_XBGR8888:
+            return AV_PIX_FMT_0BGR32;
+        case SDL_PIXELFORMAT_RGB24:
+            return AV_PIX_FMT_RGB24;
+        case SDL_PIXELFORMAT_BGR24:
+            return AV_PIX_FMT_BGR24;
+        default:
+            return AV_PIX_FMT_NONE;
+    }
+}
+
+static enum AVPixelFormat GetRecorderPixelFormat(const AVCodec* codec)
+{
+    if (!codec->pix_fmts) {
+        return AV_PIX_FMT_YUV420P;
+    }
+    for (int i = 0; codec->pix_fmts[i] != AV_PIX_FMT_NONE; ++i) {
+        if (codec->pix_fmts[i] == AV_PIX_FMT_YUV420P) {
+            return AV_PIX_FMT_YUV420P;
+        }
+    }
+    return codec->pix_fmts[0];
+}
+
+/* Open the encoder and start the file, at the size of the first frame */
+static SDL_bool OpenRecorderEncoder(VideoRecorder* recorder, int width, int height)
+{
+    const AVCodec* codec = avcodec_find_encoder(recorder->oc->oformat->video_codec);
+    int result;
+
+    if (!codec) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "No video encoder for %s",
+                     recorder->oc->oformat->name);
+        return SDL_FALSE;
+    }
+    recorder->context = avcodec_alloc_context3(codec);
+    if (!recorder->context) {
+        return SDL_FALSE;
+    }
+    /* Chroma subsampled formats need an even size */
+    recorder->context->width = width & ~1;
+    recorder->context->height = height & ~1;
+    recorder->context->pix_fmt = GetRecorderPixelFormat(codec);
+    recorder->context->time_base = AVRational{1, 1000};
+    recorder->context->thread_count = recorder->threads;
+    if (recorder->oc->oformat->flags & AVFMT_GLOBALHEADER) {
+        recorder->context->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    }
+    result = avcodec_open2(recorder->context, codec, NULL);
+    if (result < 0) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Couldn't open encoder %s: %d", codec->name,
+                     result);
+        return SDL_FALSE;
+    }
+
+    recorder->frame->format = recorder->context->pix_fmt;
+    recorder->frame->width = recorder->context->width;
+    recorder->frame->height = recorder->context->height;
+    if (av_frame_get_buffer(recorder->frame, 0) < 0) {
+        return SDL_FALSE;
+    }
+
+    recorder->stream = avformat_new_stream(recorder->oc, NULL);
+    if (!recorder->stream) {
+        return SDL_FALSE;
+    }
+    recorder->stream->time_base = recorder->context->time_base;
+    result = avcodec_parameters_from_context(recorder->stream->codecpar, recorder->context);
+    if (result < 0) {
+        return SDL_FALSE;
+    }
+
+    if (!(recorder->oc->oformat->flags & AVFMT_NOFILE)) {
+        result = avio_open(&recorder->oc->pb, recorder->path, AVIO_FLAG_WRITE);
+        if (result < 0) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Couldn't create %s: %d", recorder->path,
+                         result);
+            return SDL_FALSE;
+        }
+    }
+    result = avformat_write_header(recorder->oc, NULL);
+    if (result < 0) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Couldn't write %s: %d", recorder->path,
+                     result);
+        return SDL_FALSE;
+    }
+    recorder->header_written = SDL_TRUE;
+
+    SDL_Log("Recording %dx%d %s to %s with %s\n", recorder->context->width,
+            recorder->context->height, av_get_pix_fmt_name(recorder->context->pix_fmt),
+            recorder->path, codec->name);
+    return SDL_TRUE;
+}
+
+/* Send a frame, or NULL to drain the encoder, and mux the packets */
+static SDL_bool EncodeRecorderFrame(VideoRecorder* recorder, AVFrame* frame)
+{
+    int result = avcodec_send_frame(recorder->context, frame);
+    if (result < 0) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "avcodec_send_frame failed: %d", result);
+        return SDL_FALSE;
+    }
+    for (;;) {
+        result = avcodec_receive_packet(recorder->context, recorder->pkt);
+        if (result == AVERROR(EAGAIN) || result == AVERROR_EOF) {
+            return SDL_TRUE;
+        }
+        if (result < 0) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "avcodec_receive_packet failed: %d",
+                         result);
+            return SDL_FALSE;
+        }
+        av_packet_rescale_ts(recorder->pkt, recorder->context->time_base,
+                             recorder->stream->time_base);
+        recorder->pkt->stream_index = recorder->stream->index;
+        result = av_interleaved_write_frame(recorder->oc, recorder->pkt);
+        if (result < 0) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "av_interleaved_write_frame failed: %d",
+                         result);
+            return SDL_FALSE;
+        }
+    }
+}
+
+static SDL_bool EncodeRecordedFrame(VideoRecorder* recorder, const RecordedFrame* recorded)
+{
+    SDL_Surface* surface = recorded->surface;
+    SDL_Surface* converted = NULL;
+
+    if (!recorder->context && !OpenRecorderEncoder(recorder, surface->w, surface->h)) {
+        return SDL_FALSE;
+    }
+
+    enum AVPixelFormat format = GetSurfacePixelFormat(surface->format->format);
+    if (format == AV_PIX_FMT_NONE) {
+        /* Not a format libswscale takes directly, go through one it does */
+        converted = SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_ARGB8888);
+        if (!converted) {
+            return SDL_FALSE;
+        }
+        surface = converted;
+        format = AV_PIX_FMT_RGB32;
+    }
+
+    /* The window may have been resized since recording started, the file keeps its size */
+    recorder->sws = sws_getCachedContext(recorder->sws, surface->w, surface->h, format,
+                                         recorder->context->width, recorder->context->height,
+                                         recorder->context->pix_fmt, SWS_BILINEAR, NULL, NULL,
+                                         NULL);
+    SDL_bool encoded = SDL_FALSE;
+    if (recorder->sws && av_frame_make_writable(recorder->frame) >= 0) {
+        const Uint8* planes[] = {(const Uint8*)surface->pixels};
+        const int pitches[] = {surface->pitch};
+        sws_scale(recorder->sws, planes, pitches, 0, surface->h, recorder->frame->data,
+                  recorder->frame->linesize);
+        recorder->frame->pts = recorded->pts;
+        encoded = EncodeRecorderFrame(recorder, recorder->frame);
+    }
+    if (converted) {
+        SDL_DestroySurface(converted);
+    }
+    return encoded;
+}
+
+static int SDLCALL VideoRecorderThread(void* data)
+{
+    VideoRecorder* recorder = (VideoRecorder*)data;
+    SDL_bool failed = SDL_FALSE;
+
+    SetTraceThreadName("record");
+
+    SDL_LockMutex(recorder->lock);
+    for (;;) {
+        while (recorder->count == 0 && !recorder->quit) {
+            SDL_WaitCondition(recorder->frame_ready, recorder->lock);
+        }
+        if (recorder->count == 0) {
+            /* Every frame that was read back has been encoded */
+            break;
+        }
+        RecordedFrame* recorded = &recorder->queue[recorder->head];
+        SDL_UnlockMutex(recorder->lock);
+
+        Uint64 start = SDL_GetPerformanceCounter();
+        if (!failed) {
+            TRACE_SCOPE("record encode");
+            failed = !EncodeRecordedFrame(recorder, recorded);
+        }
+        SDL_DestroySurface(recorded->surface);
+        recorded->surface = NULL;
+
+        SDL_LockMutex(recorder->lock);
+        recorder->head = (recorder->head + 1) % VIDEO_RECORDER_QUEUE_SIZE;
+        --recorder->count;
+        if (failed) {
+            /* Stop reading frames back, nothing more can be written */
+            recorder->failed = SDL_TRUE;
+        } else {
+            recorder->encode_ticks += SDL_GetPerformanceCounter() - start;
+            ++recorder->encoded;
+        }
+    }
+    SDL_UnlockMutex(recorder->lock);
+
+    if (recorder->header_written) {
+        if (!failed) {
+            EncodeRecorderFrame(recorder, NULL);
+        }
+        int result = av_write_trailer(recorder->oc);
+        if (result < 0) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Couldn't finish %s: %d", recorder->path,
+                         result);
+        }
+    }
+    return 0;
+}
+
+VideoRecorder* CreateVideoRecorder(const char* path, int threads)
+{
+    VideoRecorder* recorder = static_cast<VideoRecorder*>(SDL_calloc(1, sizeof(*recorder)));
+    if (!recorder) {
+        return NULL;
+    }
+    recorder->path = SDL_strdup(path);
+    recorder->threads = threads;
+    recorder->last_pts = -1;
+    recorder->lock = SDL_CreateMutex();
+    recorder->frame_ready = SDL_CreateCondition();
+    recorder->frame = av_frame_alloc();
+    recorder->pkt = av_packet_alloc();
+    if (!recorder->path || !recorder->lock || !recorder->frame_ready || !recorder->frame ||
+        !recorder->pkt) {
+        DestroyVideoRecorder(recorder);
+        return NULL;
+    }
+
+    /* Find out about a container we can't write now, rather than after the first frame */
+    int result = avformat_alloc_output_context2(&recorder->oc, NULL, NULL, path);
+    if (result < 0) {
+        SDL_SetError("Couldn't find a container for %s: %d", path, result);
+        DestroyVideoRecorder(recorder);
+        return NULL;
+    }
+
+    recorder->thread = SDL_CreateThread(VideoRecorderThread, "record", recorder);
+    if (!recorder->thread) {
+        DestroyVideoRecorder(recorder);
+        return NULL;
+    }
+    return recorder;
+}
+
+SDL_bool VideoRecorderHasRoom(VideoRecorder* recorder)
+{
+    SDL_LockMutex(recorder->lock);
+    SDL_bool failed = recorder->failed;
+    SDL_bool full = (recorder->count == VIDEO_RECORDER_QUEUE_SIZE) ? SDL_TRUE : SDL_FALSE;
+    SDL_UnlockMutex(recorder->lock);
+    if (failed) {
+        return SDL_FALSE;
+    }
+    if (full) {
+        /* The encoder is behind */
+        ++recorder->dropped;
+        return SDL_FALSE;
+    }
+    return SDL_TRUE;
+}
+
+void RecordFrameSurface(VideoRecorder* recorder, SDL_Surface* surface, Uint64 read_ticks)
+{
+    recorder->read_ticks += read_ticks;
+    if (!surface) {
+        ++recorder->dropped;
+        return;
+    }
+    ++recorder->read_back;
+
+    /* Timed by when the frame was presented, each one at least a millisecond after the last */
+    Uint64 now = SDL_GetTicks();
+    if (!recorder->start_ticks) {
+        recorder->start_ticks = now;
+    }
+    Sint64 pts = (Sint64)(now - recorder->start_ticks);
+    if (pts <= recorder->last_pts) {
+        pts = recorder->last_pts + 1;
+    }
+    recorder->last_pts = pts;
+
+    /* Only the render thread adds frames, so the slot VideoRecorderHasRoom() found is still
+     * free
+     */
+    SDL_LockMutex(recorder->lock);
+    int tail = (recorder->head + recorder->count) % VIDEO_RECORDER_QUEUE_SIZE;
+    recorder->queue[tail].surface = surface;
+    recorder->queue[tail].pts = pts;
+    ++recorder->count;
+    SDL_SignalCondition(recorder->frame_ready);
+    SDL_UnlockMutex(recorder->lock);
+}
+
+void AddVideoRecorderMemory(VideoRecorder* recorder, MemoryReport* report)
+{
+    if (!recorder) {
+        return;
+    }
+
+    SDL_LockMutex(recorder->lock);
+    for (int i = 0; i < recorder->count; ++i) {
+        int index = (recorder->head + i) % VIDEO_RECORDER_QUEUE_SIZE;
+        SDL_Surface* surface = recorder->queue[index].surface;
+        AddMemory(report, MEMORY_FRAMES, (Uint64)surface->pitch * surface->h);
+    }
+    SDL_UnlockMutex(recorder->lock);
+}
+
+void LogVideoRecorderStats(VideoRecorder* recorder)
+{
+    if (!recorder || recorder->read_back + recorder->dropped == 0) {
+        return;
+    }
+
+    double frequency = (double)SDL_GetPerformanceFrequency();
+    SDL_LockMutex(recorder->lock);
+    SDL_Log("Recording: %d frames encoded, %d dropped, %.2f ms read back, %.2f ms encoded per "
+            "frame\n",
+            recorder->encoded, recorder->dropped,
+            recorder->read_back
+                ? recorder->read_ticks * 1000.0 / frequency / recorder->read_back
+                : 0.0,
+            recorder->encoded ? recorder->encode_ticks * 1000.0 / frequency / recorder->encoded
+                              : 0.0);
+    SDL_UnlockMutex(recorder->lock);
+}
+
+void DestroyVideoRecorder(VideoRecorder* recorder)
+{
+    if (!recorder) {
+        return;
+    }
+
+    if (recorder->thread) {
+        SDL_LockMutex(recorder->lock);
+        recorder->quit = SDL_TRUE;
+        SDL_SignalCondition(recorder->frame_ready);
+        SDL_UnlockMutex(recorder->lock);
+        SDL_WaitThread(recorder->thread, NULL);
+    }
+    for (int i = 0; i < VIDEO_RECORDER_QUEUE_SIZE; ++i) {
+        if (recorder->queue[i].surface) {
+            SDL_DestroySurface(recorder->queue[i].surface);
+        }
+    }
+    sws_freeContext(recorder->sws);
+    avcodec_free_context(&recorder->context);
+    av_frame_free(&recorder->frame);
+    av_packet_free(&recorder->pkt);
+    if (recorder->oc) {
+        if (!(recorder->oc->oformat->flags & AVFMT_NOFILE)) {
+            avio_closep(&recorder->oc->pb);
+        }
+        avformat_free_context(recorder->oc);
+    }
+    if (recorder->frame_ready) {
+        SDL_DestroyCondition(recorder->frame_ready);
+    }
+    if (recorder->lock) {
+        SDL_DestroyMutex(recorder->lock);
+    }
+    SDL_free(recorder->path);
+    SDL_free(recorder);
+}
@@ -0,0 +1,46 @@
+/*
+  Copyright (C) 1997-2024 Sam Lantinga <slouken@libsdl.org>
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely.
+*/
+
+/* Records the composited output, video and sprites together, to a video file. Each presented
+ * frame is read back on the render thread and queued for an encoder thread, which converts,
+ * encodes and muxes it. When the queue is full the frame is dropped and counted, the render
+ * loop never waits for the encoder. The file is timed by when frames were presented, so it
+ * plays back at the pace it was rendered.
+ */
+typedef struct VideoRecorder VideoRecorder;
+
+/* Frames read back and waiting for the encoder */
+#define VIDEO_RECORDER_QUEUE_SIZE 8
+
+/* The container comes from the file name, and the codec is the container's default.
+ * threads is the encoder thread count, 0 lets the encoder decide.
+ */
+extern VideoRecorder* CreateVideoRecorder(const char* path, int threads);
+
+/* Whether the encoder has room for another frame, if not the frame is dropped and counted.
+ * Check it before paying for the read back.
+ */
+extern SDL_bool VideoRecorderHasRoom(VideoRecorder* recorder);
+
+/* Queue a frame read back with SDL_RenderReadPixels() before SDL_RenderPresent(), the recorder
+ * takes ownership of the surface. NULL counts a failed read back as dropped. read_ticks is how
+ * long the read back took, in performance counter ticks.
+ */
+extern void RecordFrameSurface(VideoRecorder* recorder, SDL_Surface* surface, Uint64 read_ticks);
+
+typedef struct MemoryReport MemoryReport;
+
+extern void AddVideoRecorderMemory(VideoRecorder* recorder, MemoryReport* report);
+extern void LogVideoRecorderStats(VideoRecorder* recorder);
+
+/* Encodes the frames still queued and finishes the file */
+extern void DestroyVideoRecorder(VideoRecorder* recorder);
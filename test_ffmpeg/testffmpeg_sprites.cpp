@@ -0,0 +1,506 @@
+/*
+  Copyright (C) 1997-2024 Sam Lantinga <slouken@libsdl.org>
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely.
+*/
+#include <stdlib.h>
+
+#include <SDL3/SDL.h>
+
+#include "testffmpeg_pool.h"
+#include "testffmpeg_sprites.h"
+
+/* Sprites per parallel job, a multiple of the SIMD width */
+#define SPRITE_CHUNK_SIZE 8192
+#define SPRITE_SIMD_WIDTH 4
+
+typedef void (*MoveSpriteAxisFunction)(float* position, float* velocity, int count, float limit);
+
+struct SpriteLayer
+{
+    int count;
+    int capacity; /* count rounded up to the SIMD width */
+    float w, h;
+    float* x;
+    float* y;
+    float* vx;
+    float* vy;
+    SDL_Vertex* vertices;
+    int* indices;
+    MoveSpriteAxisFunction move_axis;
+
+    /* Bounds for the current update */
+    float max_x;
+    float max_y;
+
+    /* Uniform grid spatial hash for sprite to sprite collisions, rebuilt every update.
+     * Sprites are counting-sorted by cell: cell_start[c]..cell_start[c+1] indexes sorted[].
+     */
+    SDL_bool collisions;
+    float cell_size;
+    int grid_w;
+    int grid_h;
+    int* cell;
+    int* sorted;
+    int* cell_start;
+    SDL_AtomicInt* cell_count;
+    float* next_vx;
+    float* next_vy;
+
+    Uint64 update_time;
+    Uint64 update_count;
+};
+
+/* Bounce off the walls without branching: a sprite that left [0, limit) has its velocity
+ * negated and is stepped back inside, everything else just moves.
+ */
+static void MoveSpriteAxis_Scalar(float* position, float* velocity, int count, float limit)
+{
+    for (int i = 0; i < count; ++i) {
+        float p = position[i] + velocity[i];
+        int out = (p < 0.0f) | (p >= limit);
+        float v = out ? -velocity[i] : velocity[i];
+        velocity[i] = v;
+        position[i] = out ? p + v : p;
+    }
+}
+
+#ifdef SDL_SSE2_INTRINSICS
+static void SDL_TARGETING("sse2")
+    MoveSpriteAxis_SSE2(float* position, float* velocity, int count, float limit)
+{
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 max = _mm_set1_ps(limit);
+    const __m128 sign = _mm_set1_ps(-0.0f);
+
+    for (int i = 0; i < count; i += 4) {
+        __m128 p = _mm_load_ps(&position[i]);
+        __m128 v = _mm_load_ps(&velocity[i]);
+        p = _mm_add_ps(p, v);
+        __m128 out = _mm_or_ps(_mm_cmplt_ps(p, zero), _mm_cmpge_ps(p, max));
+        v = _mm_xor_ps(v, _mm_and_ps(out, sign));
+        p = _mm_add_ps(p, _mm_and_ps(out, v));
+        _mm_store_ps(&position[i], p);
+        _mm_store_ps(&velocity[i], v);
+    }
+}
+#endif
+
+#ifdef SDL_NEON_INTRINSICS
+static void MoveSpriteAxis_NEON(float* position, float* velocity, int count, float limit)
+{
+    const float32x4_t zero = vdupq_n_f32(0.0f);
+    const float32x4_t max = vdupq_n_f32(limit);
+    const uint32x4_t sign = vdupq_n_u32(0x80000000);
+
+    for (int i = 0; i < count; i += 4) {
+        float32x4_t p = vld1q_f32(&position[i]);
+        uint32x4_t v = vreinterpretq_u32_f32(vld1q_f32(&velocity[i]));
+        p = vaddq_f32(p, vreinterpretq_f32_u32(v));
+        uint32x4_t out = vorrq_u32(vcltq_f32(p, zero), vcgeq_f32(p, max));
+        v = veorq_u32(v, vandq_u32(out, sign));
+        p = vaddq_f32(p, vreinterpretq_f32_u32(vandq_u32(out, v)));
+        vst1q_f32(&position[i], p);
+        vst1q_f32(&velocity[i], vreinterpretq_f32_u32(v));
+    }
+}
+#endif
+
+static MoveSpriteAxisFunction GetMoveSpriteAxisFunction(void)
+{
+#ifdef SDL_SSE2_INTRINSICS
+    if (SDL_HasSSE2()) {
+        return MoveSpriteAxis_SSE2;
+    }
+#endif
+#ifdef SDL_NEON_INTRINSICS
+    if (SDL_HasNEON()) {
+        return MoveSpriteAxis_NEON;
+    }
+#endif
+    return MoveSpriteAxis_Scalar;
+}
+
+static float* AllocateSpriteArray(int capacity)
+{
+    size_t size = SDL_max(capacity, SPRITE_SIMD_WIDTH) * sizeof(float);
+    float* array = (float*)SDL_aligned_alloc(SDL_SIMDGetAlignment(), size);
+    if (array) {
+        SDL_memset(array, 0, size);
+    }
+    return array;
+}
+
+SpriteLayer* CreateSpriteLayer(int count, int sprite_w, int sprite_h, int area_w, int area_h)
+{
+    SpriteLayer* layer = static_cast<SpriteLayer*>(SDL_calloc(1, sizeof(*layer)));
+    if (!layer) {
+        return NULL;
+    }
+
+    layer->count = count;
+    layer->capacity = (count + SPRITE_SIMD_WIDTH - 1) & ~(SPRITE_SIMD_WIDTH - 1);
+    layer->w = (float)sprite_w;
+    layer->h = (float)sprite_h;
+    layer->move_axis = GetMoveSpriteAxisFunction();
+
+    /* The padding past count is zero, so it never moves and is never drawn */
+    layer->x = AllocateSpriteArray(layer->capacity);
+    layer->y = AllocateSpriteArray(layer->capacity);
+    layer->vx = AllocateSpriteArray(layer->capacity);
+    layer->vy = AllocateSpriteArray(layer->capacity);
+    layer->vertices = (SDL_Vertex*)SDL_malloc(SDL_max(count, 1) * 4 * sizeof(*layer->vertices));
+    layer->indices = (int*)SDL_malloc(SDL_max(count, 1) * 6 * sizeof(*layer->indices));
+    if (!layer->x || !layer->y || !layer->vx || !layer->vy || !layer->vertices ||
+        !layer->indices) {
+        DestroySpriteLayer(layer);
+        return NULL;
+    }
+
+    /* Position sprites and set their velocities */
+    for (int i = 0; i < count; ++i) {
+        layer->x[i] = (float)(rand() % SDL_max(area_w - sprite_w, 1));
+        layer->y[i] = (float)(rand() % SDL_max(area_h - sprite_h, 1));
+        while (layer->vx[i] == 0.f || layer->vy[i] == 0.f) {
+            layer->vx[i] = (float)((rand() % (2 + 1)) - 1);
+            layer->vy[i] = (float)((rand() % (2 + 1)) - 1);
+        }
+    }
+
+    /* All the sprites are drawn with one geometry batch, only the positions change */
+    for (int i = 0; i < count; ++i) {
+        SDL_Vertex* vertex = &layer->vertices[i * 4];
+        int* index = &layer->indices[i * 6];
+
+        for (int j = 0; j < 4; ++j) {
+            vertex[j].color.r = 1.0f;
+            vertex[j].color.g = 1.0f;
+            vertex[j].color.b = 1.0f;
+            vertex[j].color.a = 1.0f;
+            vertex[j].tex_coord.x = (j == 1 || j == 2) ? 1.0f : 0.0f;
+            vertex[j].tex_coord.y = (j >= 2) ? 1.0f : 0.0f;
+        }
+
+        index[0] = i * 4 + 0;
+        index[1] = i * 4 + 1;
+        index[2] = i * 4 + 2;
+        index[3] = i * 4 + 0;
+        index[4] = i * 4 + 2;
+        index[5] = i * 4 + 3;
+    }
+
+    return layer;
+}
+
+static void WriteSpriteVertices(SpriteLayer* layer, int start, int end)
+{
+    for (int i = start; i < end; ++i) {
+        SDL_Vertex* vertex = &layer->vertices[i * 4];
+        float x0 = layer->x[i];
+        float y0 = layer->y[i];
+        float x1 = x0 + layer->w;
+        float y1 = y0 + layer->h;
+
+        vertex[0].position.x = x0;
+        vertex[0].position.y = y0;
+        vertex[1].position.x = x1;
+        vertex[1].position.y = y0;
+        vertex[2].position.x = x1;
+        vertex[2].position.y = y1;
+        vertex[3].position.x = x0;
+        vertex[3].position.y = y1;
+    }
+}
+
+static int GetSpriteCell(SpriteLayer* layer, float x, float y)
+{
+    int cx = SDL_clamp((int)(x / layer->cell_size), 0, layer->grid_w - 1);
+    int cy = SDL_clamp((int)(y / layer->cell_size), 0, layer->grid_h - 1);
+    return cy * layer->grid_w + cx;
+}
+
+static void HashSprites(SpriteLayer* layer, int start, int end)
+{
+    for (int i = start; i < end; ++i) {
+        int cell = GetSpriteCell(layer, layer->x[i], layer->y[i]);
+        layer->cell[i] = cell;
+        SDL_AtomicAdd(&layer->cell_count[cell], 1);
+    }
+}
+
+static void UpdateSpriteChunk(void* userdata, int index)
+{
+    SpriteLayer* layer = (SpriteLayer*)userdata;
+    int start = index * SPRITE_CHUNK_SIZE;
+    int end = SDL_min(start + SPRITE_CHUNK_SIZE, layer->capacity);
+
+    layer->move_axis(&layer->x[start], &layer->vx[start], end - start, layer->max_x);
+    layer->move_axis(&layer->y[start], &layer->vy[start], end - start, layer->max_y);
+
+    /* Fill in the vertices and hash the sprites while the chunk is still in cache */
+    WriteSpriteVertices(layer, start, SDL_min(end, layer->count));
+    if (layer->collisions) {
+        HashSprites(layer, start, SDL_min(end, layer->count));
+    }
+}
+
+static void SortSpriteChunk(void* userdata, int index)
+{
+    SpriteLayer* layer = (SpriteLayer*)userdata;
+    int start = index * SPRITE_CHUNK_SIZE;
+    int end = SDL_min(start + SPRITE_CHUNK_SIZE, layer->count);
+
+    /* cell_count holds each cell's next free slot at this point */
+    for (int i = start; i < end; ++i) {
+        layer->sorted[SDL_AtomicAdd(&layer->cell_count[layer->cell[i]], 1)] = i;
+    }
+}
+
+static void CollideSpriteChunk(void* userdata, int index)
+{
+    SpriteLayer* layer = (SpriteLayer*)userdata;
+    int start = index * SPRITE_CHUNK_SIZE;
+    int end = SDL_min(start + SPRITE_CHUNK_SIZE, layer->count);
+    float w = layer->w;
+    float h = layer->h;
+
+    /* Each sprite only writes its own next velocity, from the current velocities of the sprites
+     * it hits, so chunks can run in any order.
+     */
+    for (int i = start; i < end; ++i) {
+        float x = layer->x[i];
+        float y = layer->y[i];
+        float vx = layer->vx[i];
+        float vy = layer->vy[i];
+        int cx = layer->cell[i] % layer->grid_w;
+        int cy = layer->cell[i] / layer->grid_w;
+        SDL_bool hit = SDL_FALSE;
+
+        /* Sprites are no bigger than a cell, so anything touching is in a neighbouring cell */
+        for (int ny = SDL_max(cy - 1, 0); ny <= SDL_min(cy + 1, layer->grid_h - 1) && !hit; ++ny) {
+            for (int nx = SDL_max(cx - 1, 0); nx <= SDL_min(cx + 1, layer->grid_w - 1) && !hit;
+                 ++nx) {
+                int c = ny * layer->grid_w + nx;
+                for (int k = layer->cell_start[c]; k < layer->cell_start[c + 1]; ++k) {
+                    int j = layer->sorted[k];
+                    float dx = layer->x[j] - x;
+                    float dy = layer->y[j] - y;
+                    float overlap_x = w - SDL_fabsf(dx);
+                    float overlap_y = h - SDL_fabsf(dy);
+
+                    if (j == i || overlap_x <= 0.0f || overlap_y <= 0.0f) {
+                        continue;
+                    }
+
+                    /* Equal mass elastic collision along the axis of least penetration: if
+                     * the pair is closing, take the other sprite's velocity on that axis.
+                     */
+                    if (overlap_x < overlap_y) {
+                        if ((vx - layer->vx[j]) * dx > 0.0f) {
+                            vx = layer->vx[j];
+                            hit = SDL_TRUE;
+                        }
+                    } else {
+                        if ((vy - layer->vy[j]) * dy > 0.0f) {
+                            vy = layer->vy[j];
+                            hit = SDL_TRUE;
+                        }
+                    }
+                    if (hit) {
+                        break;
+                    }
+                }
+            }
+        }
+        layer->next_vx[i] = vx;
+        layer->next_vy[i] = vy;
+    }
+}
+
+static SDL_bool CreateSpriteGrid(SpriteLayer* layer, int area_w, int area_h)
+{
+    int grid_w = SDL_max((int)SDL_ceil(area_w / layer->cell_size), 1);
+    int grid_h = SDL_max((int)SDL_ceil(area_h / layer->cell_size), 1);
+
+    if (grid_w == layer->grid_w && grid_h == layer->grid_h) {
+        return SDL_TRUE;
+    }
+
+    SDL_free(layer->cell_start);
+    SDL_free(layer->cell_count);
+    layer->cell_start = (int*)SDL_malloc((grid_w * grid_h + 1) * sizeof(*layer->cell_start));
+    layer->cell_count =
+        (SDL_AtomicInt*)SDL_malloc(grid_w * grid_h * sizeof(*layer->cell_count));
+    if (!layer->cell_start || !layer->cell_count) {
+        layer->grid_w = 0;
+        layer->grid_h = 0;
+        return SDL_FALSE;
+    }
+    layer->grid_w = grid_w;
+    layer->grid_h = grid_h;
+    return SDL_TRUE;
+}
+
+void UpdateSpriteLayer(SpriteLayer* layer, int area_w, int area_h, WorkerPool* pool)
+{
+    Uint64 start = SDL_GetPerformanceCounter();
+    int chunks = (layer->capacity + SPRITE_CHUNK_SIZE - 1) / SPRITE_CHUNK_SIZE;
+    SDL_bool collisions = layer->collisions;
+
+    layer->max_x = (float)area_w - layer->w;
+    layer->max_y = (float)area_h - layer->h;
+
+    if (layer->count < SPRITE_LAYER_PARALLEL_COUNT) {
+        /* Not worth waking up the pool */
+        pool = NULL;
+    }
+
+    if (collisions && !CreateSpriteGrid(layer, area_w, area_h)) {
+        collisions = SDL_FALSE;
+    }
+    if (collisions) {
+        SDL_memset(layer->cell_count, 0, layer->grid_w * layer->grid_h * sizeof(SDL_AtomicInt));
+    } else {
+        layer->collisions = SDL_FALSE;
+    }
+
+    /* Move the sprites, counting how many land in each cell */
+    RunWorkerPoolRange(pool, chunks, UpdateSpriteChunk, layer);
+
+    if (collisions) {
+        int num_cells = layer->grid_w * layer->grid_h;
+        int offset = 0;
+
+        /* The prefix sum is over cells, not sprites, so it's cheap to do serially */
+        for (int c = 0; c < num_cells; ++c) {
+            int count = SDL_AtomicGet(&layer->cell_count[c]);
+            layer->cell_start[c] = offset;
+            SDL_AtomicSet(&layer->cell_count[c], offset);
+            offset += count;
+        }
+        layer->cell_start[num_cells] = offset;
+
+        RunWorkerPoolRange(pool, chunks, SortSpriteChunk, layer);
+        RunWorkerPoolRange(pool, chunks, CollideSpriteChunk, layer);
+
+        float* vx = layer->vx;
+        float* vy = layer->vy;
+        layer->vx = layer->next_vx;
+        layer->vy = layer->next_vy;
+        layer->next_vx = vx;
+        layer->next_vy = vy;
+    }
+
+    layer->update_time += SDL_GetPerformanceCounter() - start;
+    ++layer->update_count;
+}
+
+SDL_bool SetSpriteLayerCollisions(SpriteLayer* layer, SDL_bool enabled)
+{
+    if (enabled && !layer->cell) {
+        layer->cell = (int*)SDL_malloc(SDL_max(layer->count, 1) * sizeof(*layer->cell));
+        layer->sorted = (int*)SDL_malloc(SDL_max(layer->count, 1) * sizeof(*layer->sorted));
+        layer->next_vx = AllocateSpriteArray(layer->capacity);
+        layer->next_vy = AllocateSpriteArray(layer->capacity);
+        if (!layer->cell || !layer->sorted || !layer->next_vx || !layer->next_vy) {
+            return SDL_FALSE;
+        }
+        /* Padding lanes past count are moved but never collided, keep them sane after a swap */
+        SDL_memcpy(layer->next_vx, layer->vx, layer->capacity * sizeof(*layer->vx));
+        SDL_memcpy(layer->next_vy, layer->vy, layer->capacity * sizeof(*layer->vy));
+    }
+    layer->cell_size = SDL_max(layer->w, layer->h);
+    layer->collisions = enabled;
+    return SDL_TRUE;
+}
+
+void RenderSpriteLayer(SpriteLayer* layer, SDL_Renderer* renderer, SDL_Texture* texture)
+{
+    if (layer->count > 0) {
+        SDL_RenderGeometry(renderer, texture, layer->vertices, layer->count * 4, layer->indices,
+                           layer->count * 6);
+    }
+}
+
+static double GetSpriteUpdateMS(SpriteLayer* layer)
+{
+    if (!layer->update_count) {
+        return 0.0;
+    }
+    return (double)layer->update_time * 1000.0 / SDL_GetPerformanceFrequency() /
+           layer->update_count;
+}
+
+void LogSpriteLayerStats(SpriteLayer* layer)
+{
+    double update_ms = GetSpriteUpdateMS(layer);
+
+    if (layer->count > 0 && layer->update_count > 0) {
+        SDL_Log("Sprite update: %d sprites, %.3f ms per frame, %.3f ms per million sprites\n",
+                layer->count, update_ms, update_ms * 1000000.0 / layer->count);
+    }
+}
+
+void DestroySpriteLayer(SpriteLayer* layer)
+{
+    if (layer) {
+        SDL_aligned_free(layer->x);
+        SDL_aligned_free(layer->y);
+        SDL_aligned_free(layer->vx);
+        SDL_aligned_free(layer->vy);
+        SDL_aligned_free(layer->next_vx);
+        SDL_aligned_free(layer->next_vy);
+        SDL_free(layer->cell);
+        SDL_free(layer->sorted);
+        SDL_free(layer->cell_start);
+        SDL_free(layer->cell_count);
+        SDL_free(layer->vertices);
+        SDL_free(layer->indices);
+        SDL_free(layer);
+    }
+}
+
+static void RunSpriteBenchmarkPass(const char* name, SpriteLayer* layer, WorkerPool* pool)
+{
+    const int warmup = 10;
+    const int iterations = 200;
+
+    for (int i = 0; i < warmup; ++i) {
+        UpdateSpriteLayer(layer, 1920, 1080, pool);
+    }
+    layer->update_time = 0;
+    layer->update_count = 0;
+    for (int i = 0; i < iterations; ++i) {
+        UpdateSpriteLayer(layer, 1920, 1080, pool);
+    }
+
+    double update_ms = GetSpriteUpdateMS(layer);
+    SDL_Log("Sprite benchmark (%s): %d sprites, %.3f ms per update, %.3f ms per million sprites\n",
+            name, layer->count, update_ms, update_ms * 1000000.0 / layer->count);
+}
+
+int RunSpriteBenchmark(int count, SDL_bool collisions, WorkerPool* pool)
+{
+    SpriteLayer* layer = CreateSpriteLayer(count, 32, 32, 1920, 1080);
+    if (!layer || !SetSpriteLayerCollisions(layer, collisions)) {
+        DestroySpriteLayer(layer);
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Out of memory!\n");
+        return -1;
+    }
+
+    RunSpriteBenchmarkPass("1 thread", layer, NULL);
+    if (pool && count >= SPRITE_LAYER_PARALLEL_COUNT) {
+        char name[32];
+        SDL_snprintf(name, sizeof(name), "%d threads", GetWorkerPoolThreadCount(pool) + 1);
+        RunSpriteBenchmarkPass(name, layer, pool);
+    }
+
+    DestroySpriteLayer(layer);
+    return 0;
+}
@@ -0,0 +1,34 @@
+/*
+  Copyright (C) 1997-2024 Sam Lantinga <slouken@libsdl.org>
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely.
+*/
+
+typedef struct WorkerPool WorkerPool;
+
+/* The bouncing sprites drawn over the video, stored as structure-of-arrays */
+typedef struct SpriteLayer SpriteLayer;
+
+/* Layers with at least this many sprites are updated in parallel on the worker pool */
+#define SPRITE_LAYER_PARALLEL_COUNT 32768
+
+extern SpriteLayer* CreateSpriteLayer(int count,
+                                      int sprite_w,
+                                      int sprite_h,
+                                      int area_w,
+                                      int area_h);
+/* Bounce sprites off each other as well as the walls */
+extern SDL_bool SetSpriteLayerCollisions(SpriteLayer* layer, SDL_bool enabled);
+extern void UpdateSpriteLayer(SpriteLayer* layer, int area_w, int area_h, WorkerPool* pool);
+extern void RenderSpriteLayer(SpriteLayer* layer, SDL_Renderer* renderer, SDL_Texture* texture);
+extern void LogSpriteLayerStats(SpriteLayer* layer);
+extern void DestroySpriteLayer(SpriteLayer* layer);
+
+/* Time the sprite update without rendering, returns 0 on success */
+extern int RunSpriteBenchmark(int count, SDL_bool collisions, WorkerPool* pool);
@@ -0,0 +1,160 @@
+/*
+  Copyright (C) 1997-2024 Sam Lantinga <slouken@libsdl.org>
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely.
+*/
+#include <SDL3/SDL.h>
+
+extern "C" {
+#include <libavfilter/avfilter.h>
+#include <libavfilter/buffersink.h>
+#include <libavfilter/buffersrc.h>
+#include <libavutil/channel_layout.h>
+#include <libavutil/samplefmt.h>
+}
+
+#include "testffmpeg_filter.h"
+#include "testffmpeg_tempo.h"
+
+/* Older versions of atempo only accept 0.5 to 2.0, so larger changes are chained */
+#define ATEMPO_MIN 0.5
+#define ATEMPO_MAX 2.0
+
+struct AudioTempo
+{
+    double tempo;
+    AVFilterGraph* graph;
+    AVFilterContext* src;
+    AVFilterContext* sink;
+    AVFrame* output;
+    SDL_bool failed;
+    SDL_bool flushed;
+};
+
+AudioTempo* CreateAudioTempo(double tempo)
+{
+    AudioTempo* filter = static_cast<AudioTempo*>(SDL_calloc(1, sizeof(*filter)));
+    if (!filter) {
+        return NULL;
+    }
+    filter->tempo = SDL_clamp(tempo, MIN_AUDIO_TEMPO, MAX_AUDIO_TEMPO);
+    filter->output = av_frame_alloc();
+    if (!filter->output) {
+        SDL_free(filter);
+        return NULL;
+    }
+    return filter;
+}
+
+static void GetAudioTempoChain(double tempo, char* chain, size_t maxlen)
+{
+    size_t len = 0;
+
+    chain[0] = '\0';
+    while (tempo > ATEMPO_MAX) {
+        len += SDL_snprintf(chain + len, maxlen - len, "atempo=%g,", ATEMPO_MAX);
+        tempo /= ATEMPO_MAX;
+    }
+    while (tempo < ATEMPO_MIN) {
+        len += SDL_snprintf(chain + len, maxlen - len, "atempo=%g,", ATEMPO_MIN);
+        tempo /= ATEMPO_MIN;
+    }
+    SDL_snprintf(chain + len, maxlen - len, "atempo=%g", tempo);
+}
+
+static SDL_bool CreateAudioTempoGraph(AudioTempo* filter, const AVFrame* frame)
+{
+    char layout[128];
+    char args[512];
+    char chain[128];
+    int result;
+
+    filter->graph = avfilter_graph_alloc();
+    if (!filter->graph) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "avfilter_graph_alloc failed");
+        return SDL_FALSE;
+    }
+    /* The graph runs on the decode thread, which is already busy enough */
+    filter->graph->nb_threads = 1;
+
+    av_channel_layout_describe(&frame->ch_layout, layout, sizeof(layout));
+    SDL_snprintf(args, sizeof(args),
+                 "time_base=1/%d:sample_rate=%d:sample_fmt=%s:channel_layout=%s",
+                 frame->sample_rate, frame->sample_rate,
+                 av_get_sample_fmt_name((enum AVSampleFormat)frame->format), layout);
+    result = avfilter_graph_create_filter(&filter->src, avfilter_get_by_name("abuffer"), "in",
+                                          args, NULL, filter->graph);
+    if (result < 0) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Couldn't create abuffer filter: %d", result);
+        return SDL_FALSE;
+    }
+    result = avfilter_graph_create_filter(&filter->sink, avfilter_get_by_name("abuffersink"),
+                                          "out", NULL, NULL, filter->graph);
+    if (result < 0) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Couldn't create abuffersink filter: %d",
+                     result);
+        return SDL_FALSE;
+    }
+
+    GetAudioTempoChain(filter->tempo, chain, sizeof(chain));
+    if (!ConfigureFilterGraph(filter->graph, filter->src, filter->sink, chain)) {
+        return SDL_FALSE;
+    }
+    SDL_Log("Audio tempo %.2fx: %s\n", filter->tempo, chain);
+    return SDL_TRUE;
+}
+
+SDL_bool SendAudioTempoFrame(AudioTempo* filter, AVFrame* frame)
+{
+    if (filter->failed || filter->flushed) {
+        return SDL_FALSE;
+    }
+    if (!filter->graph) {
+        if (!frame) {
+            /* Nothing was ever queued, so there's nothing to flush */
+            filter->flushed = SDL_TRUE;
+            return SDL_FALSE;
+        }
+        if (!CreateAudioTempoGraph(filter, frame)) {
+            /* Don't try again for every frame */
+            filter->failed = SDL_TRUE;
+            return SDL_FALSE;
+        }
+    }
+    if (!frame) {
+        filter->flushed = SDL_TRUE;
+    }
+
+    /* Keep a reference, the decoder reuses the frame for the next receive */
+    int result = av_buffersrc_add_frame_flags(filter->src, frame, AV_BUFFERSRC_FLAG_KEEP_REF);
+    if (result < 0) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "av_buffersrc_add_frame failed: %d", result);
+        return SDL_FALSE;
+    }
+    return SDL_TRUE;
+}
+
+AVFrame* ReceiveAudioTempoFrame(AudioTempo* filter)
+{
+    av_frame_unref(filter->output);
+    if (!filter->graph || av_buffersink_get_frame(filter->sink, filter->output) < 0) {
+        return NULL;
+    }
+    return filter->output;
+}
+
+void DestroyAudioTempo(AudioTempo* filter)
+{
+    if (!filter) {
+        return;
+    }
+    avfilter_graph_free(&filter->graph);
+    av_frame_free(&filter->output);
+    SDL_free(filter);
+}
@@ -0,0 +1,33 @@
+/*
+  Copyright (C) 1997-2024 Sam Lantinga <slouken@libsdl.org>
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely.
+*/
+
+extern "C" {
+#include <libavutil/frame.h>
+}
+
+/* An atempo filter graph that speeds up or slows down decoded audio without changing its pitch */
+typedef struct AudioTempo AudioTempo;
+
+/* The range of playback speeds that the tempo filter supports */
+#define MIN_AUDIO_TEMPO 0.25
+#define MAX_AUDIO_TEMPO 4.0
+
+/* The graph is created from the first frame, so it always matches the decoder output */
+extern AudioTempo* CreateAudioTempo(double tempo);
+
+/* Queue a decoded frame, or NULL at the end of the stream to flush what the filter holds */
+extern SDL_bool SendAudioTempoFrame(AudioTempo* tempo, AVFrame* frame);
+
+/* Returns the next stretched frame, valid until the next call, or NULL if there are none yet */
+extern AVFrame* ReceiveAudioTempoFrame(AudioTempo* tempo);
+
+extern void DestroyAudioTempo(AudioTempo* tempo);
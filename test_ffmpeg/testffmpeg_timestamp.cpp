@@ -0,0 +1,158 @@
+/*
+  Copyright (C) 1997-2024 Sam Lantinga <slouken@libsdl.org>
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely.
+*/
+#include <SDL3/SDL.h>
+
+extern "C" {
+#include <libavutil/hwcontext.h>
+#include <libavutil/pixdesc.h>
+#include <libavutil/time.h>
+}
+
+#include "testffmpeg_timestamp.h"
+
+/* The pattern is a marker byte, the time, and a checksum of the time, most significant bit on
+ * the left. The marker and checksum keep ordinary video from being read as a time.
+ */
+#define TIMESTAMP_MARKER 0xA5
+#define TIMESTAMP_MS_BITS 40
+#define TIMESTAMP_BITS (8 + TIMESTAMP_MS_BITS + 8)
+
+/* Blocks are sized to the frame width, so the pattern survives scaling and compression */
+#define TIMESTAMP_BLOCKS_ACROSS 64
+#define TIMESTAMP_MIN_BLOCK_SIZE 4
+
+static const Sint64 TIMESTAMP_MS_MASK = ((Sint64)1 << TIMESTAMP_MS_BITS) - 1;
+
+static int GetTimestampBlockSize(int width, int height)
+{
+    int block = width / TIMESTAMP_BLOCKS_ACROSS;
+    if (block < TIMESTAMP_MIN_BLOCK_SIZE || height < block) {
+        return 0;
+    }
+    return block;
+}
+
+static Uint8 GetTimestampChecksum(Sint64 ms)
+{
+    Uint8 sum = 0;
+    for (int i = 0; i < TIMESTAMP_MS_BITS; i += 8) {
+        sum += (Uint8)(ms >> i);
+    }
+    return (Uint8)~sum;
+}
+
+Sint64 GetTimestampClockMS(void)
+{
+    return (av_gettime() / 1000) & TIMESTAMP_MS_MASK;
+}
+
+Sint64 GetTimestampAgeMS(Sint64 ms)
+{
+    Sint64 age = GetTimestampClockMS() - ms;
+    if (age < 0) {
+        /* The clock wrapped since the pattern was drawn */
+        age += TIMESTAMP_MS_MASK + 1;
+    }
+    return age;
+}
+
+SDL_bool DrawTimestampPattern(AVFrame* rgb, Sint64 ms)
+{
+    int block = GetTimestampBlockSize(rgb->width, rgb->height);
+
+    if (!block || rgb->format != AV_PIX_FMT_RGB24) {
+        return SDL_FALSE;
+    }
+
+    ms &= TIMESTAMP_MS_MASK;
+    Uint64 bits = ((Uint64)TIMESTAMP_MARKER << (TIMESTAMP_MS_BITS + 8)) | ((Uint64)ms << 8) |
+                  GetTimestampChecksum(ms);
+    for (int y = 0; y < block; ++y) {
+        Uint8* row = rgb->data[0] + y * rgb->linesize[0];
+        for (int i = 0; i < TIMESTAMP_BITS; ++i) {
+            int value = ((bits >> (TIMESTAMP_BITS - 1 - i)) & 1) ? 0xFF : 0x00;
+            SDL_memset(&row[i * block * 3], value, block * 3);
+        }
+    }
+    return SDL_TRUE;
+}
+
+/* Sample the middle of each block in a frame in system memory */
+static SDL_bool ReadTimestampBits(const AVFrame* frame, Uint64* bits)
+{
+    const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get((enum AVPixelFormat)frame->format);
+    const Uint64 unreadable = (AV_PIX_FMT_FLAG_BE | AV_PIX_FMT_FLAG_PAL |
+                               AV_PIX_FMT_FLAG_BITSTREAM | AV_PIX_FMT_FLAG_HWACCEL |
+                               AV_PIX_FMT_FLAG_FLOAT);
+    int block = GetTimestampBlockSize(frame->width, frame->height);
+
+    if (!desc || !block || (desc->flags & unreadable)) {
+        return SDL_FALSE;
+    }
+
+    /* Luma, or green for RGB formats, is enough to tell black from white */
+    const AVComponentDescriptor* comp = &desc->comp[(desc->flags & AV_PIX_FMT_FLAG_RGB) ? 1 : 0];
+    const Uint8* row = frame->data[comp->plane] + (block / 2) * frame->linesize[comp->plane];
+    int threshold = 1 << (comp->depth - 1);
+
+    *bits = 0;
+    for (int i = 0; i < TIMESTAMP_BITS; ++i) {
+        const Uint8* sample = row + (i * block + block / 2) * comp->step + comp->offset;
+        int value;
+        if (comp->depth + comp->shift > 8) {
+            Uint16 value16;
+            SDL_memcpy(&value16, sample, sizeof(value16));
+            value = SDL_SwapLE16(value16);
+        } else {
+            value = *sample;
+        }
+        value = (value >> comp->shift) & ((1 << comp->depth) - 1);
+        *bits = (*bits << 1) | (value >= threshold ? 1 : 0);
+    }
+    return SDL_TRUE;
+}
+
+SDL_bool ReadTimestampPattern(const AVFrame* frame, Sint64* ms)
+{
+    Uint64 bits;
+    SDL_bool read;
+
+    if (frame->hw_frames_ctx) {
+        AVFrame* mapped = av_frame_alloc();
+        if (!mapped) {
+            return SDL_FALSE;
+        }
+        /* Mapping doesn't copy the frame, but not every device supports it */
+        if (av_hwframe_map(mapped, frame, AV_HWFRAME_MAP_READ) < 0) {
+            av_frame_unref(mapped);
+            if (av_hwframe_transfer_data(mapped, frame, 0) < 0) {
+                av_frame_free(&mapped);
+                return SDL_FALSE;
+            }
+        }
+        read = ReadTimestampBits(mapped, &bits);
+        av_frame_free(&mapped);
+    } else {
+        read = ReadTimestampBits(frame, &bits);
+    }
+    if (!read) {
+        return SDL_FALSE;
+    }
+
+    Sint64 value = (Sint64)(bits >> 8) & TIMESTAMP_MS_MASK;
+    if ((bits >> (TIMESTAMP_MS_BITS + 8)) != TIMESTAMP_MARKER ||
+        (Uint8)bits != GetTimestampChecksum(value)) {
+        return SDL_FALSE;
+    }
+    *ms = value;
+    return SDL_TRUE;
+}
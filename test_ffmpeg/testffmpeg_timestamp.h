@@ -0,0 +1,35 @@
+/*
+  Copyright (C) 1997-2024 Sam Lantinga <slouken@libsdl.org>
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely.
+*/
+
+extern "C" {
+#include <libavutil/frame.h>
+}
+
+/* A row of black and white blocks across the top of a video frame, holding the wall clock time
+ * the frame was made. A live source draws it, and the player reads it back once the frame is on
+ * screen to measure the glass-to-glass latency. The source and the player have to share a clock,
+ * so they have to run on the same machine.
+ */
+
+/* The wall clock in milliseconds, wrapped to what the pattern can hold */
+extern Sint64 GetTimestampClockMS(void);
+
+/* How long ago a time read from a pattern was, in milliseconds */
+extern Sint64 GetTimestampAgeMS(Sint64 ms);
+
+/* Draw the time into an RGB24 frame, returns SDL_FALSE if the frame is too narrow for it */
+extern SDL_bool DrawTimestampPattern(AVFrame* rgb, Sint64 ms);
+
+/* Read the time from a decoded frame, hardware frames are mapped to system memory to read it.
+ * Returns SDL_FALSE if the frame doesn't have a pattern, or the pixel format can't be read.
+ */
+extern SDL_bool ReadTimestampPattern(const AVFrame* frame, Sint64* ms);
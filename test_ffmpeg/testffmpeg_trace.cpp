@@ -0,0 +1,254 @@
+/*
+  Copyright (C) 1997-2024 Sam Lantinga <slouken@libsdl.org>
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely.
+*/
+#include <SDL3/SDL.h>
+
+#include "testffmpeg_trace.h"
+
+/* Events are stored in chunks, so recording never copies what's already there */
+#define TRACE_CHUNK_EVENTS 4096
+
+/* About 32 MB per thread, later events are counted but not kept */
+#define TRACE_MAX_CHUNKS 256
+
+typedef struct TraceEvent
+{
+    const char* name;
+    Uint64 start;
+    Uint64 duration;
+    Sint64 frame_id;
+} TraceEvent;
+
+typedef struct TraceChunk
+{
+    TraceEvent events[TRACE_CHUNK_EVENTS];
+    int count;
+    struct TraceChunk* next;
+} TraceChunk;
+
+/* Only the owning thread writes to its buffer, they're read after every thread is done */
+typedef struct TraceBuffer
+{
+    int tid;
+    char name[32];
+    TraceChunk* head;
+    TraceChunk* tail;
+    int num_chunks;
+    int dropped;
+    struct TraceBuffer* next;
+} TraceBuffer;
+
+static char* trace_file;
+static Uint64 trace_start;
+static SDL_AtomicInt trace_enabled;
+static SDL_AtomicInt trace_packet_id;
+static SDL_Mutex* trace_lock;
+static TraceBuffer* trace_buffers;
+static int trace_num_buffers;
+static thread_local TraceBuffer* trace_buffer;
+
+SDL_bool StartTrace(const char* file)
+{
+    trace_file = SDL_strdup(file);
+    trace_lock = SDL_CreateMutex();
+    if (!trace_file || !trace_lock) {
+        StopTrace();
+        return SDL_FALSE;
+    }
+    trace_start = SDL_GetPerformanceCounter();
+    SDL_AtomicSet(&trace_enabled, 1);
+    return SDL_TRUE;
+}
+
+SDL_bool IsTraceEnabled(void)
+{
+    return SDL_AtomicGet(&trace_enabled) ? SDL_TRUE : SDL_FALSE;
+}
+
+static TraceBuffer* GetTraceBuffer(void)
+{
+    if (trace_buffer) {
+        return trace_buffer;
+    }
+
+    TraceBuffer* buffer = static_cast<TraceBuffer*>(SDL_calloc(1, sizeof(*buffer)));
+    if (!buffer) {
+        return NULL;
+    }
+    SDL_LockMutex(trace_lock);
+    buffer->tid = ++trace_num_buffers;
+    SDL_snprintf(buffer->name, sizeof(buffer->name), "thread %d", buffer->tid);
+    buffer->next = trace_buffers;
+    trace_buffers = buffer;
+    SDL_UnlockMutex(trace_lock);
+
+    trace_buffer = buffer;
+    return buffer;
+}
+
+void SetTraceThreadName(const char* name)
+{
+    if (!IsTraceEnabled()) {
+        return;
+    }
+
+    TraceBuffer* buffer = GetTraceBuffer();
+    if (buffer) {
+        SDL_strlcpy(buffer->name, name, sizeof(buffer->name));
+    }
+}
+
+Uint64 BeginTraceEvent(void)
+{
+    if (!IsTraceEnabled()) {
+        return 0;
+    }
+    return SDL_GetPerformanceCounter();
+}
+
+void EndTraceEvent(const char* name, Sint64 frame_id, Uint64 start)
+{
+    if (!start || !IsTraceEnabled()) {
+        return;
+    }
+
+    Uint64 now = SDL_GetPerformanceCounter();
+    TraceBuffer* buffer = GetTraceBuffer();
+    if (!buffer) {
+        return;
+    }
+
+    TraceChunk* chunk = buffer->tail;
+    if (!chunk || chunk->count == TRACE_CHUNK_EVENTS) {
+        if (buffer->num_chunks == TRACE_MAX_CHUNKS) {
+            ++buffer->dropped;
+            return;
+        }
+        chunk = static_cast<TraceChunk*>(SDL_malloc(sizeof(*chunk)));
+        if (!chunk) {
+            ++buffer->dropped;
+            return;
+        }
+        chunk->count = 0;
+        chunk->next = NULL;
+        if (buffer->tail) {
+            buffer->tail->next = chunk;
+        } else {
+            buffer->head = chunk;
+        }
+        buffer->tail = chunk;
+        ++buffer->num_chunks;
+    }
+
+    TraceEvent* event = &chunk->events[chunk->count++];
+    event->name = name;
+    event->start = start;
+    event->duration = now - start;
+    event->frame_id = frame_id;
+}
+
+Sint64 SetPacketTraceID(AVPacket* packet)
+{
+    if (!IsTraceEnabled()) {
+        return 0;
+    }
+    packet->opaque = (void*)(intptr_t)(SDL_AtomicAdd(&trace_packet_id, 1) + 1);
+    return GetPacketTraceID(packet);
+}
+
+Sint64 GetPacketTraceID(const AVPacket* packet)
+{
+    return IsTraceEnabled() ? (Sint64)(intptr_t)packet->opaque : 0;
+}
+
+Sint64 GetFrameTraceID(const AVFrame* frame)
+{
+    return IsTraceEnabled() ? (Sint64)(intptr_t)frame->opaque : 0;
+}
+
+static double GetTraceMicroseconds(Uint64 ticks)
+{
+    return (double)ticks * 1000000.0 / SDL_GetPerformanceFrequency();
+}
+
+static void WriteTrace(void)
+{
+    SDL_IOStream* io = SDL_IOFromFile(trace_file, "w");
+    int events = 0;
+    int dropped = 0;
+
+    if (!io) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Couldn't write %s: %s", trace_file,
+                    SDL_GetError());
+        return;
+    }
+
+    SDL_IOprintf(io, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    SDL_IOprintf(io, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":"
+                     "\"testffmpeg\"}}");
+    for (TraceBuffer* buffer = trace_buffers; buffer; buffer = buffer->next) {
+        SDL_IOprintf(io,
+                     ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+                     "\"args\":{\"name\":\"%s\"}}",
+                     buffer->tid, buffer->name);
+
+        for (TraceChunk* chunk = buffer->head; chunk; chunk = chunk->next) {
+            for (int i = 0; i < chunk->count; ++i) {
+                TraceEvent* event = &chunk->events[i];
+                SDL_IOprintf(io,
+                             ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+                             "\"ts\":%.3f,\"dur\":%.3f",
+                             event->name, buffer->tid,
+                             GetTraceMicroseconds(event->start - trace_start),
+                             GetTraceMicroseconds(event->duration));
+                if (event->frame_id) {
+                    SDL_IOprintf(io, ",\"args\":{\"frame\":%" SDL_PRIs64 "}", event->frame_id);
+                }
+                SDL_IOprintf(io, "}");
+            }
+            events += chunk->count;
+        }
+        dropped += buffer->dropped;
+    }
+    SDL_IOprintf(io, "\n]}\n");
+    SDL_CloseIO(io);
+
+    SDL_Log("Wrote %d trace events to %s\n", events, trace_file);
+    if (dropped > 0) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Dropped %d trace events", dropped);
+    }
+}
+
+void StopTrace(void)
+{
+    if (IsTraceEnabled()) {
+        SDL_AtomicSet(&trace_enabled, 0);
+        WriteTrace();
+    }
+
+    while (trace_buffers) {
+        TraceBuffer* buffer = trace_buffers;
+        trace_buffers = buffer->next;
+        while (buffer->head) {
+            TraceChunk* chunk = buffer->head;
+            buffer->head = chunk->next;
+            SDL_free(chunk);
+        }
+        SDL_free(buffer);
+    }
+    trace_num_buffers = 0;
+    if (trace_lock) {
+        SDL_DestroyMutex(trace_lock);
+        trace_lock = NULL;
+    }
+    SDL_free(trace_file);
+    trace_file = NULL;
+}
@@ -0,0 +1,70 @@
+/*
+  Copyright (C) 1997-2024 Sam Lantinga <slouken@libsdl.org>
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely.
+*/
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/frame.h>
+}
+
+/* Timed events collected in per-thread buffers and written as Chrome trace-event JSON at exit,
+ * for chrome://tracing or ui.perfetto.dev. Events can carry the ID of the frame they worked on.
+ */
+extern SDL_bool StartTrace(const char* file);
+extern SDL_bool IsTraceEnabled(void);
+
+/* Name the calling thread in the timeline */
+extern void SetTraceThreadName(const char* name);
+
+/* Returns 0 if tracing is off, name must be a string constant */
+extern Uint64 BeginTraceEvent(void);
+extern void EndTraceEvent(const char* name, Sint64 frame_id, Uint64 start);
+
+/* Packets are numbered as they're demuxed, and decoders copy the number to their frames.
+ * These return 0 if tracing is off.
+ */
+extern Sint64 SetPacketTraceID(AVPacket* packet);
+extern Sint64 GetPacketTraceID(const AVPacket* packet);
+extern Sint64 GetFrameTraceID(const AVFrame* frame);
+
+/* Write the trace, every other thread that records events must be finished */
+extern void StopTrace(void);
+
+/* Times the enclosing block */
+class TraceScope final
+{
+public:
+    explicit TraceScope(const char* name, Sint64 frame_id = 0)
+        : name_(name)
+        , frame_id_(frame_id)
+        , start_(BeginTraceEvent())
+    {
+    }
+    ~TraceScope()
+    {
+        EndTraceEvent(name_, frame_id_, start_);
+    }
+
+    /* For blocks that only find out which frame they worked on at the end */
+    void SetFrame(Sint64 frame_id)
+    {
+        frame_id_ = frame_id;
+    }
+
+private:
+    const char* name_;
+    Sint64 frame_id_;
+    Uint64 start_;
+};
+
+#define TRACE_CONCAT2(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT2(a, b)
+#define TRACE_SCOPE(...) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(__VA_ARGS__)
@@ -12,6 +12,7 @@
 #include <SDL3/SDL.h>
 #include <SDL3/SDL_vulkan.h>
 
+#include "testffmpeg_trace.h"
 #include "testffmpeg_vulkan.h"
 
 #ifdef FFMPEG_VULKAN_SUPPORT
@@ -909,7 +910,9 @@ int BeginVulkanFrameRendering(VulkanVideoContext* context, AVFrame* frame, SDL_R
         pVkFrame->queue_family[0] = VK_QUEUE_FAMILY_IGNORED;
     }
 
+    Uint64 trace_start = BeginTraceEvent();
     VkResult result = context->vkQueueSubmit(context->graphicsQueue, 1, &submitInfo, 0);
+    EndTraceEvent("vulkan acquire submit", GetFrameTraceID(frame), trace_start);
     if (result != VK_SUCCESS) {
         // Don't return an error here, we need to complete the frame operation
         SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "vkQueueSubmit(): %s",
@@ -947,7 +950,9 @@ int FinishVulkanFrameRendering(VulkanVideoContext* context, AVFrame* frame, SDL_
     submitInfo.pSignalSemaphores = pVkFrame->sem;
     submitInfo.pNext = &timeline;
 
+    Uint64 trace_start = BeginTraceEvent();
     VkResult result = context->vkQueueSubmit(context->graphicsQueue, 1, &submitInfo, 0);
+    EndTraceEvent("vulkan release submit", GetFrameTraceID(frame), trace_start);
     if (result != VK_SUCCESS) {
         // Don't return an error here, we need to complete the frame operation
         SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "vkQueueSubmit(): %s",